@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <Jolt/Core/Memory.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include "allocator.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+static const char *cCategoryNames[MemoryCategory::NUM_CATEGORIES] = {
+  "other", "shapes", "bodies", "system", "temp", "step"
+};
+
+// Category of the blocks of the throwaway systems which measure the contact cache, they are not counted
+static const int cProbeCategory = MemoryCategory::NUM_CATEGORIES;
+
+// Header in front of each tracked block
+struct BlockHeader
+{
+  uint64 size;
+  uint32 category;
+  uint32 offset;
+};
+
+static_assert(sizeof(BlockHeader) == 16, "header must keep the default alignment of malloc");
+
+struct CategoryCounters
+{
+  atomic<int64> current;
+  atomic<int64> peak;
+  atomic<uint64> allocations;
+  atomic<uint64> allocated;
+};
+
+// Size classes of the slab allocator are powers of two from cMinSlabSize to 16 KiB
+static const int cNumSlabClasses = 10;
+static const size_t cMinSlabSize = 32;
+static const size_t cSlabChunkSize = 256 * 1024;
+
+// Free lists of the calling thread, a block freed by another thread joins the free list of that thread. Lists longer
+// than two chunks spill one chunk worth of blocks to the depot and empty lists are refilled from it before a new chunk
+// is carved, so blocks which are allocated on one thread and freed on another flow back. The lists of a thread are
+// returned to the depot when it exits.
+struct SlabCache
+{
+  void *free[cNumSlabClasses];
+  size_t count[cNumSlabClasses];
+  bool exited;
+  ~SlabCache();
+};
+
+// Free lists shared by all threads
+struct SlabDepot
+{
+  std::mutex lock;
+  void *free[cNumSlabClasses];
+};
+
+static bool tracking = false;
+static bool slabs = false;
+static SlabDepot slab_depot;
+static thread_local SlabCache slab_cache;
+static atomic<int> current_category(MemoryCategory::OTHER);
+static CategoryCounters counters[MemoryCategory::NUM_CATEGORIES];
+static atomic<int64> total_current(0);
+static atomic<int64> total_peak(0);
+static atomic<bool> probing(false);
+static atomic<int64> probe_bytes(0);
+static int64 contact_cache_bytes = -1;
+static uint contact_cache_pairs = 0;
+static uint contact_cache_constraints = 0;
+static uint64 steps = 0;
+static uint64 step_allocations = 0;
+static uint64 max_step_allocations = 0;
+static uint64 step_bytes = 0;
+static uint64 max_step_bytes = 0;
+
+static void updatePeak(atomic<int64> &peak, int64 value)
+{
+  int64 previous = peak.load(memory_order_relaxed);
+  while (value > previous && !peak.compare_exchange_weak(previous, value, memory_order_relaxed));
+}
+
+// Size class of a block including the header, -1 if the block is too large or needs a larger alignment than the
+// blocks of the slab allocator provide (chunks are aligned to 64 bytes)
+static int slabClass(size_t total, size_t offset)
+{
+  if (!slabs || offset > 64 || total > (cMinSlabSize << (cNumSlabClasses - 1)))
+    return -1;
+  int result = 0;
+  while ((cMinSlabSize << result) < total)
+    result++;
+  return result;
+}
+
+static size_t blocksPerChunk(int size_class)
+{
+  return cSlabChunkSize / (cMinSlabSize << size_class);
+}
+
+// Move up to count blocks from the front of one list to the other, returns the number of blocks moved
+static size_t moveBlocks(void *&from, void *&to, size_t count)
+{
+  size_t moved = 0;
+  while (from != nullptr && moved < count) {
+    void *block = from;
+    from = *(void **)block;
+    *(void **)block = to;
+    to = block;
+    moved++;
+  };
+  return moved;
+}
+
+SlabCache::~SlabCache()
+{
+  lock_guard<std::mutex> lock(slab_depot.lock);
+  for (int i=0; i<cNumSlabClasses; i++) {
+    moveBlocks(free[i], slab_depot.free[i], count[i]);
+    count[i] = 0;
+  };
+  exited = true;
+}
+
+static void *slabAllocate(int size_class)
+{
+  void *&head = slab_cache.free[size_class];
+  size_t &count = slab_cache.count[size_class];
+  if (head == nullptr) {
+    lock_guard<std::mutex> lock(slab_depot.lock);
+    count += moveBlocks(slab_depot.free[size_class], head, blocksPerChunk(size_class));
+  };
+  if (head == nullptr) {
+    // Chunks are never returned to the system, their blocks are reused through the free lists
+    size_t size = cMinSlabSize << size_class;
+    char *chunk = (char *)aligned_alloc(64, cSlabChunkSize);
+    if (chunk == nullptr)
+      return nullptr;
+    for (size_t i=0; i+size<=cSlabChunkSize; i+=size) {
+      *(void **)(chunk + i) = head;
+      head = chunk + i;
+      count++;
+    };
+  };
+  void *block = head;
+  head = *(void **)block;
+  count--;
+  return block;
+}
+
+static void slabFree(int size_class, void *block)
+{
+  if (slab_cache.exited) {
+    // Blocks freed by the destructors of other thread locals after the lists of the thread were returned
+    lock_guard<std::mutex> lock(slab_depot.lock);
+    *(void **)block = slab_depot.free[size_class];
+    slab_depot.free[size_class] = block;
+    return;
+  };
+  void *&head = slab_cache.free[size_class];
+  size_t &count = slab_cache.count[size_class];
+  *(void **)block = head;
+  head = block;
+  count++;
+  size_t batch = blocksPerChunk(size_class);
+  if (count > 2 * batch) {
+    lock_guard<std::mutex> lock(slab_depot.lock);
+    count -= moveBlocks(head, slab_depot.free[size_class], batch);
+  };
+}
+
+static void *allocateBlock(size_t size, size_t alignment)
+{
+  size_t offset = max(alignment, sizeof(BlockHeader));
+  int size_class = slabClass(offset + size, offset);
+  void *base;
+  if (size_class >= 0) {
+    base = slabAllocate(size_class);
+    if (base == nullptr)
+      return nullptr;
+  } else if (posix_memalign(&base, max(alignment, sizeof(void *)), offset + size) != 0)
+    return nullptr;
+  char *block = (char *)base + offset;
+  int category = probing.load(memory_order_relaxed) ? cProbeCategory : current_category.load(memory_order_relaxed);
+  BlockHeader *header = (BlockHeader *)block - 1;
+  header->size = size;
+  header->category = category;
+  header->offset = offset;
+  if (tracking && category == cProbeCategory)
+    probe_bytes.fetch_add(size, memory_order_relaxed);
+  else if (tracking) {
+    CategoryCounters &counter = counters[category];
+    updatePeak(counter.peak, counter.current.fetch_add(size, memory_order_relaxed) + size);
+    counter.allocations.fetch_add(1, memory_order_relaxed);
+    counter.allocated.fetch_add(size, memory_order_relaxed);
+    updatePeak(total_peak, total_current.fetch_add(size, memory_order_relaxed) + size);
+  };
+  return block;
+}
+
+static void freeBlock(void *block)
+{
+  if (block == nullptr)
+    return;
+  BlockHeader *header = (BlockHeader *)block - 1;
+  size_t size = header->size;
+  size_t offset = header->offset;
+  if (tracking && (int)header->category == cProbeCategory)
+    probe_bytes.fetch_sub(size, memory_order_relaxed);
+  else if (tracking) {
+    counters[header->category].current.fetch_sub(size, memory_order_relaxed);
+    total_current.fetch_sub(size, memory_order_relaxed);
+  };
+  int size_class = slabClass(offset + size, offset);
+  if (size_class >= 0)
+    slabFree(size_class, (char *)block - offset);
+  else
+    free((char *)block - offset);
+}
+
+static void *allocateDefault(size_t size)
+{
+  return allocateBlock(size, sizeof(BlockHeader));
+}
+
+static void *reallocateBlock(void *block, size_t old_size, size_t new_size)
+{
+  void *result = allocateBlock(new_size, sizeof(BlockHeader));
+  if (block != nullptr) {
+    if (result != nullptr)
+      memcpy(result, block, min(old_size, new_size));
+    freeBlock(block);
+  };
+  return result;
+}
+
+void registerAllocator(const Options &options)
+{
+  tracking = options.has("track-memory");
+  string allocator = options.getString("allocator", "default");
+  slabs = allocator == "slab";
+  if (!slabs && allocator != "default")
+    cerr << "Unknown allocator " << allocator << ", using the default allocator" << endl;
+  if (!tracking && !slabs) {
+    RegisterDefaultAllocator();
+    return;
+  };
+  Allocate = allocateDefault;
+  Reallocate = reallocateBlock;
+  Free = freeBlock;
+  AlignedAllocate = allocateBlock;
+  AlignedFree = freeBlock;
+}
+
+bool memoryTracking()
+{
+  return tracking;
+}
+
+int setMemoryCategory(int category)
+{
+  return current_category.exchange(category, memory_order_relaxed);
+}
+
+MemoryScope::MemoryScope(int category):
+  category(category), previous(setMemoryCategory(category)),
+  allocations(counters[category].allocations.load(memory_order_relaxed)),
+  bytes(counters[category].allocated.load(memory_order_relaxed))
+{
+}
+
+MemoryScope::~MemoryScope()
+{
+  setMemoryCategory(previous);
+  if (category == MemoryCategory::STEP) {
+    uint64 step_count = counters[category].allocations.load(memory_order_relaxed) - allocations;
+    uint64 step_size = counters[category].allocated.load(memory_order_relaxed) - bytes;
+    steps++;
+    step_allocations += step_count;
+    max_step_allocations = max(max_step_allocations, step_count);
+    step_bytes += step_size;
+    max_step_bytes = max(max_step_bytes, step_size);
+  };
+}
+
+// Bytes held after PhysicsSystem::Init by a system with a single body and the given limits
+static int64 probeSystem(uint num_body_mutexes, uint max_body_pairs, uint max_contact_constraints,
+                         const BroadPhaseLayerInterface &broad_phase_layer_interface,
+                         const ObjectVsBroadPhaseLayerFilter &object_vs_broadphase_layer_filter,
+                         const ObjectLayerPairFilter &object_layer_pair_filter)
+{
+  probe_bytes = 0;
+  probing = true;
+  int64 result;
+  {
+    PhysicsSystem probe;
+    probe.Init(1, num_body_mutexes, max_body_pairs, max_contact_constraints, broad_phase_layer_interface,
+               object_vs_broadphase_layer_filter, object_layer_pair_filter);
+    result = probe_bytes;
+  }
+  probing = false;
+  return result;
+}
+
+void initPhysicsSystem(PhysicsSystem &physics_system, uint max_bodies, uint num_body_mutexes, uint max_body_pairs,
+                       uint max_contact_constraints, const BroadPhaseLayerInterface &broad_phase_layer_interface,
+                       const ObjectVsBroadPhaseLayerFilter &object_vs_broadphase_layer_filter,
+                       const ObjectLayerPairFilter &object_layer_pair_filter)
+{
+  if (tracking) {
+    contact_cache_bytes = probeSystem(num_body_mutexes, max_body_pairs, max_contact_constraints,
+                                      broad_phase_layer_interface, object_vs_broadphase_layer_filter,
+                                      object_layer_pair_filter) -
+                          probeSystem(num_body_mutexes, 1, 1, broad_phase_layer_interface,
+                                      object_vs_broadphase_layer_filter, object_layer_pair_filter);
+    contact_cache_pairs = max_body_pairs;
+    contact_cache_constraints = max_contact_constraints;
+  };
+  MemoryScope scope(MemoryCategory::SYSTEM);
+  physics_system.Init(max_bodies, num_body_mutexes, max_body_pairs, max_contact_constraints, broad_phase_layer_interface,
+                      object_vs_broadphase_layer_filter, object_layer_pair_filter);
+}
+
+void printMemoryReport(ostream &stream)
+{
+  if (!tracking)
+    return;
+  char buffer[256];
+  snprintf(buffer, sizeof(buffer), "%-12s %14s %14s %12s\n", "category", "current", "peak", "allocations");
+  stream << buffer;
+  for (int i=0; i<MemoryCategory::NUM_CATEGORIES; i++) {
+    CategoryCounters &counter = counters[i];
+    snprintf(buffer, sizeof(buffer), "%-12s %14lld %14lld %12llu\n", cCategoryNames[i],
+             (long long)counter.current.load(), (long long)counter.peak.load(), (unsigned long long)counter.allocations.load());
+    stream << buffer;
+  };
+  snprintf(buffer, sizeof(buffer), "%-12s %14lld %14lld\n", "total", (long long)total_current.load(), (long long)total_peak.load());
+  stream << buffer;
+  if (contact_cache_bytes >= 0) {
+    snprintf(buffer, sizeof(buffer), "Contact cache for %u body pairs and %u contact constraints: %lld bytes of system\n",
+             contact_cache_pairs, contact_cache_constraints, (long long)contact_cache_bytes);
+    stream << buffer;
+  };
+  if (steps > 0) {
+    snprintf(buffer, sizeof(buffer), "%llu steps, allocations per step: mean %.1f max %llu, bytes per step: mean %.0f max %llu\n",
+             (unsigned long long)steps, (double)step_allocations / steps, (unsigned long long)max_step_allocations,
+             (double)step_bytes / steps, (unsigned long long)max_step_bytes);
+    stream << buffer;
+  };
+  stream.flush();
+}
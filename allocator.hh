@@ -0,0 +1,68 @@
+#pragma once
+#include <ostream>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include "options.hh"
+
+// Allocators and tracking of the heap memory used by Jolt.
+//
+// "--allocator slab" serves blocks of up to 16 KiB (including the header) from thread local free lists with power of
+// two size classes. The lists are refilled from 256 KiB chunks so that the job threads do not contend for the lock of
+// malloc, the chunks are kept until the program exits. Blocks freed by another thread than the one which allocated them
+// flow back through a shared depot: long lists spill a chunk worth of blocks into it and empty lists are refilled from
+// it before a new chunk is carved. "--allocator default" uses the default allocator of Jolt.
+//
+// With "--track-memory" the allocation hooks of Jolt (Allocate, Reallocate, Free, AlignedAllocate and AlignedFree) are
+// replaced by functions which store the size and the category in a small header in front of each block. Jolt does not
+// say what an allocation is for, so the category is the one of the innermost MemoryScope active when the block is
+// allocated. The job threads allocate with the category of the scope around PhysicsSystem::Update. Scopes of the
+// category STEP are counted as simulation steps and give the allocations per step.
+//
+// PhysicsSystem::Init creates the body table, the broadphase trees and the contact cache in one call, so they share
+// the category "system". The contact cache is preallocated for the maximum number of body pairs and contact
+// constraints and does not grow during the steps. initPhysicsSystem measures it separately by initializing two
+// throwaway systems with a single body, one with the limits of the real system and one with the smallest limits. Their
+// allocations are left out of the categories and the report shows the difference as the part of "system" used by the
+// contact cache. The contact constraints of a step are taken from the temp allocator.
+namespace MemoryCategory
+{
+  static constexpr int OTHER = 0;
+  static constexpr int SHAPES = 1;
+  static constexpr int BODIES = 2;
+  static constexpr int SYSTEM = 3;
+  static constexpr int TEMP = 4;
+  static constexpr int STEP = 5;
+  static constexpr int NUM_CATEGORIES = 6;
+};
+
+// Install the allocator selected on the command line, must be called before anything is allocated by Jolt
+void registerAllocator(const Options &options);
+
+// True if allocations are tracked
+bool memoryTracking();
+
+// Set the category of subsequent allocations and return the previous one
+int setMemoryCategory(int category);
+
+// Category of the allocations while the scope exists
+class MemoryScope
+{
+  public:
+    MemoryScope(int category);
+    ~MemoryScope();
+  private:
+    int category;
+    int previous;
+    JPH::uint64 allocations;
+    JPH::uint64 bytes;
+};
+
+// PhysicsSystem::Init with the allocations in the category SYSTEM, measures the contact cache when tracking
+void initPhysicsSystem(JPH::PhysicsSystem &physics_system, JPH::uint max_bodies, JPH::uint num_body_mutexes,
+                       JPH::uint max_body_pairs, JPH::uint max_contact_constraints,
+                       const JPH::BroadPhaseLayerInterface &broad_phase_layer_interface,
+                       const JPH::ObjectVsBroadPhaseLayerFilter &object_vs_broadphase_layer_filter,
+                       const JPH::ObjectLayerPairFilter &object_layer_pair_filter);
+
+// Print current and peak bytes and the number of allocations per category and per step (nothing if not tracking)
+void printMemoryReport(std::ostream &stream);
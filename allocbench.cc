@@ -0,0 +1,106 @@
+#include <iostream>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/Memory.h>
+#include "options.hh"
+#include "allocator.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+// Every thread keeps 256 live blocks of 16 to 2048 bytes and replaces the oldest one in each iteration
+static void churn(int threads, int iterations)
+{
+  vector<thread> workers;
+  for (int t=0; t<threads; t++)
+    workers.emplace_back([t, iterations]() {
+      mt19937 random(t);
+      uniform_int_distribution<size_t> size(16, 2048);
+      vector<void *> live(256, nullptr);
+      for (int i=0; i<iterations; i++) {
+        void *&block = live[i % live.size()];
+        if (block != nullptr)
+          Free(block);
+        block = Allocate(size(random));
+        *(char *)block = 0;
+      };
+      for (void *block: live)
+        Free(block);
+    });
+  for (thread &worker: workers)
+    worker.join();
+}
+
+// The main thread allocates blocks of 256 bytes and another thread frees them
+static void handover(int iterations)
+{
+  std::mutex queue_mutex;
+  condition_variable ready;
+  deque<void *> queue;
+  bool done = false;
+  thread consumer([&]() {
+    while (true) {
+      deque<void *> blocks;
+      {
+        unique_lock<std::mutex> lock(queue_mutex);
+        ready.wait(lock, [&]{ return done || !queue.empty(); });
+        if (queue.empty())
+          return;
+        blocks.swap(queue);
+      }
+      for (void *block: blocks)
+        Free(block);
+    };
+  });
+  for (int i=0; i<iterations; i++) {
+    void *block = Allocate(256);
+    *(char *)block = 0;
+    {
+      lock_guard<std::mutex> lock(queue_mutex);
+      queue.push_back(block);
+    }
+    if (i % 1024 == 0)
+      ready.notify_one();
+  };
+  {
+    lock_guard<std::mutex> lock(queue_mutex);
+    done = true;
+  }
+  ready.notify_one();
+  consumer.join();
+}
+
+// Allocation patterns of the job system without running a simulation ("--mode churn" or "--mode handover").
+// Compare "--allocator default" and "--allocator slab".
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  registerAllocator(options);
+  string mode = options.getString("mode", "churn");
+  int threads = options.getInt("threads", thread::hardware_concurrency());
+  int iterations = options.getInt("iterations", 2000000);
+  auto start = chrono::steady_clock::now();
+  if (mode == "churn")
+    churn(threads, iterations);
+  else if (mode == "handover")
+    handover(iterations);
+  else {
+    cerr << "Unknown mode " << mode << " (use churn or handover)" << endl;
+    return 1;
+  };
+  double time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%s allocator, %s: %.1f ms, peak resident size %ld KiB\n", options.getString("allocator", "default").c_str(),
+         mode.c_str(), time, usage.ru_maxrss);
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include "body_pool.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+BodyPool::BodyPool(BodyInterface &body_interface, const BodyCreationSettings &settings, uint size, bool reuse):
+  body_interface(body_interface), settings(settings), size(size), reuse(reuse)
+{
+  if (!reuse)
+    return;
+  for (uint i=0; i<size; i++) {
+    Body *body = body_interface.CreateBody(settings);
+    if (body == nullptr)
+      break;
+    pool.push_back(body);
+  };
+}
+
+BodyPool::~BodyPool()
+{
+  flush();
+  removeBodies(vector<Body *>(live.begin(), live.end()));
+  if (!reuse)
+    return;
+  ids.clear();
+  for (Body *body: pool)
+    ids.push_back(body->GetID());
+  body_interface.DestroyBodies(ids.data(), (int)ids.size());
+}
+
+Body *BodyPool::acquire(RVec3Arg position, QuatArg rotation)
+{
+  if (live.size() >= size)
+    return nullptr;
+  Body *body;
+  if (reuse) {
+    if (pool.empty())
+      return nullptr;
+    body = pool.back();
+    pool.pop_back();
+    // The body is not in the broad phase, this only updates its transform and clears the velocities it was removed with
+    body_interface.SetPositionRotationAndVelocity(body->GetID(), position, rotation, Vec3::sZero(), Vec3::sZero());
+  } else {
+    settings.mPosition = position;
+    settings.mRotation = rotation;
+    body = body_interface.CreateBody(settings);
+    if (body == nullptr)
+      return nullptr;
+  };
+  live.insert(body);
+  added.push_back(body->GetID());
+  return body;
+}
+
+void BodyPool::release(Body *body)
+{
+  if (live.erase(body) > 0)
+    released.push_back(body);
+}
+
+void BodyPool::removeBodies(const vector<Body *> &list)
+{
+  if (list.empty())
+    return;
+  ids.clear();
+  for (Body *body: list)
+    ids.push_back(body->GetID());
+  body_interface.RemoveBodies(ids.data(), (int)ids.size());
+  if (reuse)
+    pool.insert(pool.end(), list.begin(), list.end());
+  else
+    body_interface.DestroyBodies(ids.data(), (int)ids.size());
+}
+
+void BodyPool::flush()
+{
+  removeBodies(released);
+  released.clear();
+  if (added.empty())
+    return;
+  BodyInterface::AddState state = body_interface.AddBodiesPrepare(added.data(), (int)added.size());
+  body_interface.AddBodiesFinalize(added.data(), (int)added.size(), state, EActivation::Activate);
+  added.clear();
+}
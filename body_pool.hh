@@ -0,0 +1,39 @@
+#pragma once
+#include <unordered_set>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/Body.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+#include <Jolt/Physics/Body/BodyInterface.h>
+
+// Pool of identical bodies for objects which are spawned and removed at a high rate (debris, particles).
+//
+// All bodies are created up front. acquire() takes a body from the pool and moves it to the given transform,
+// release() marks a live body for removal and flush() removes and adds the marked bodies in one batch each, which keeps
+// the broad phase from being updated body by body. Removed bodies keep their shape and settings and go back to the
+// pool instead of being destroyed. With reuse disabled bodies are created in acquire() and destroyed in flush()
+// instead, for comparison. The pool must be flushed between physics steps and destroyed before the physics system.
+class BodyPool
+{
+  public:
+    BodyPool(JPH::BodyInterface &body_interface, const JPH::BodyCreationSettings &settings, JPH::uint size,
+             bool reuse = true);
+    ~BodyPool();
+    // Returns null if all bodies are in use
+    JPH::Body *acquire(JPH::RVec3Arg position, JPH::QuatArg rotation);
+    // The body needs to be added by flush() before it can be released
+    void release(JPH::Body *body);
+    void flush();
+    size_t numLive() const { return live.size(); }
+  private:
+    void removeBodies(const std::vector<JPH::Body *> &list);
+    JPH::BodyInterface &body_interface;
+    JPH::BodyCreationSettings settings;
+    JPH::uint size;
+    bool reuse;
+    std::unordered_set<JPH::Body *> live;
+    std::vector<JPH::Body *> pool;
+    std::vector<JPH::Body *> released;
+    JPH::BodyIDVector added;
+    JPH::BodyIDVector ids;
+};
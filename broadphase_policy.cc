@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <Jolt/Physics/Collision/BroadPhase/BroadPhaseQuery.h>
+#include <Jolt/Physics/Collision/CollisionCollectorImpl.h>
+#include "broadphase_policy.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+static const int cNumProbes = 256;
+static const int cProbeRuns = 3;
+
+static double milliseconds(chrono::steady_clock::duration duration)
+{
+  return chrono::duration<double, milli>(duration).count();
+}
+
+BroadPhasePolicy::BroadPhasePolicy(const Options &options):
+  check_interval(options.getInt("optimize-check", 0)), slowdown(options.getDouble("optimize-slowdown", 1.25)),
+  change_fraction(options.getDouble("optimize-changes", 0.2)), verbose(options.has("broadphase-stats")), random(1),
+  baseline(0.0), changes(0), steps(0), step_total(0.0), step_count(0), collision_total(0.0), collision_count(0),
+  collision_before(0.0), collision_pending(false), rebuilds(0), rebuild_time(0.0)
+{
+}
+
+void BroadPhasePolicy::createProbes(const PhysicsSystem &physics_system)
+{
+  probes.clear();
+  AABox bounds = physics_system.GetBounds();
+  if (!bounds.IsValid())
+    return;
+  // Boxes of 1/16 of the size of the world at random positions
+  Vec3 half_size = bounds.GetExtent() / 16.0f;
+  uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  for (int i=0; i<cNumProbes; i++) {
+    Vec3 center = bounds.mMin + Vec3(uniform(random), uniform(random), uniform(random)) * bounds.GetSize();
+    probes.push_back(AABox(center - half_size, center + half_size));
+  };
+}
+
+double BroadPhasePolicy::probe(const PhysicsSystem &physics_system)
+{
+  const BroadPhaseQuery &query = physics_system.GetBroadPhaseQuery();
+  AllHitCollisionCollector<CollideShapeBodyCollector> collector;
+  double result = 0.0;
+  for (int run=0; run<cProbeRuns; run++) {
+    auto start = chrono::steady_clock::now();
+    for (const AABox &box: probes) {
+      collector.Reset();
+      query.CollideAABox(box, collector);
+    };
+    double time = milliseconds(chrono::steady_clock::now() - start);
+    result = run == 0 ? time : min(result, time);
+  };
+  return result;
+}
+
+void BroadPhasePolicy::optimize(PhysicsSystem &physics_system, const char *reason)
+{
+  double before = probe(physics_system);
+  auto start = chrono::steady_clock::now();
+  physics_system.OptimizeBroadPhase();
+  double duration = milliseconds(chrono::steady_clock::now() - start);
+  double after = probe(physics_system);
+  if (verbose) {
+    if (collision_pending && collision_count > 0)
+      reportCollisions();
+    printf("Broad phase rebuilt after %u steps (%s) in %.3f ms: queries %.4f ms -> %.4f ms, mean step %.3f ms",
+           step_count, reason, duration, before, after, step_total / max(step_count, 1u));
+    if (collision_count > 0) {
+      collision_before = collision_total / collision_count;
+      collision_pending = true;
+      printf(", mean pair finding %.3f ms", collision_before);
+    };
+    printf("\n");
+  };
+  // The bounds may have grown since the probes were created
+  createProbes(physics_system);
+  baseline = probe(physics_system);
+  changes = 0;
+  step_total = 0.0;
+  step_count = 0;
+  collision_total = 0.0;
+  collision_count = 0;
+  rebuilds++;
+  rebuild_time += duration;
+}
+
+void BroadPhasePolicy::reportCollisions()
+{
+  printf("Pair finding after the rebuild: mean %.3f ms in %u steps (%.3f ms before)\n",
+         collision_total / max(collision_count, 1u), collision_count, collision_before);
+  collision_pending = false;
+}
+
+bool BroadPhasePolicy::afterStep(PhysicsSystem &physics_system, double step_time, double collision_time)
+{
+  if (check_interval <= 0)
+    return false;
+  steps++;
+  step_total += step_time;
+  step_count++;
+  if (collision_time >= 0.0) {
+    collision_total += collision_time;
+    collision_count++;
+    if (collision_pending && collision_count == (uint)check_interval)
+      reportCollisions();
+  };
+  if (changes > change_fraction * max(physics_system.GetNumBodies(), 1u)) {
+    optimize(physics_system, "bodies added or removed");
+    return true;
+  };
+  if (steps % check_interval != 0)
+    return false;
+  if (probes.empty()) {
+    createProbes(physics_system);
+    baseline = probe(physics_system);
+    return false;
+  };
+  if (probe(physics_system) <= slowdown * baseline)
+    return false;
+  optimize(physics_system, "queries slowed down");
+  return true;
+}
+
+void BroadPhasePolicy::printSummary() const
+{
+  if (check_interval > 0 && rebuilds > 0)
+    printf("Broad phase rebuilt %u times in %u steps, %.3f ms in total\n", rebuilds, steps, rebuild_time);
+}
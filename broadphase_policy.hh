@@ -0,0 +1,56 @@
+#pragma once
+#include <random>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Geometry/AABox.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include "options.hh"
+
+// Decides when to rebuild the broad phase trees of a long running simulation.
+//
+// Jolt refits the trees when bodies move and rebuilds the changed nodes in the background of every step, which keeps
+// them valid but lets their quality degrade as bodies spread out, are added or are removed. A full rebuild with
+// PhysicsSystem::OptimizeBroadPhase restores it. The policy tracks the quality by timing a fixed set of box queries
+// over the bounds of the world every "--optimize-check N" steps and rebuilds once they are "--optimize-slowdown F" times
+// (1.25 by default) slower than right after the last rebuild, or once more than "--optimize-changes F" (0.2 by default)
+// of the bodies were added or removed. The probe uses the fastest of three runs so it is not triggered by a single slow
+// run. The policy is off unless "--optimize-check" is given (60 is a good interval), so that the probes and rebuilds
+// do not change the step times of the benchmarks.
+//
+// With "--broadphase-stats" every rebuild prints the query time before and after and its own duration as well as the
+// mean step time since the previous rebuild. Jolt does not time the search for colliding pairs on its own, the caller
+// passes the collision_ms of StepStatistics ("--step-stats FILE") instead. With it the report contains the mean pair
+// finding time since the previous rebuild and, once N more steps have passed, the mean over the steps after it.
+class BroadPhasePolicy
+{
+  public:
+    BroadPhasePolicy(const Options &options);
+    // Report bodies added to or removed from the physics system
+    void bodiesChanged(JPH::uint count) { changes += count; }
+    // Call between the steps with the duration of the last step and of its collision detection (negative if unknown),
+    // returns whether the broad phase was rebuilt
+    bool afterStep(JPH::PhysicsSystem &physics_system, double step_time, double collision_time = -1.0);
+    void printSummary() const;
+  private:
+    void createProbes(const JPH::PhysicsSystem &physics_system);
+    double probe(const JPH::PhysicsSystem &physics_system);
+    void optimize(JPH::PhysicsSystem &physics_system, const char *reason);
+    void reportCollisions();
+    int check_interval;
+    double slowdown;
+    double change_fraction;
+    bool verbose;
+    std::mt19937 random;
+    std::vector<JPH::AABox> probes;
+    double baseline;
+    JPH::uint changes;
+    JPH::uint steps;
+    double step_total;
+    JPH::uint step_count;
+    double collision_total;
+    JPH::uint collision_count;
+    double collision_before;
+    bool collision_pending;
+    JPH::uint rebuilds;
+    double rebuild_time;
+};
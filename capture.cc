@@ -0,0 +1,307 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdint>
+#include "capture.hh"
+#include <GLFW/glfw3.h>
+
+
+using namespace std;
+
+static uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+{
+  static uint32_t table[256] = {0};
+  if (table[1] == 0)
+    for (uint32_t n=0; n<256; n++) {
+      uint32_t c = n;
+      for (int k=0; k<8; k++)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[n] = c;
+    };
+  crc = ~crc;
+  for (size_t i=0; i<size; i++)
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void writeBigEndian(vector<unsigned char> &buffer, uint32_t value)
+{
+  for (int shift=24; shift>=0; shift-=8)
+    buffer.push_back((value >> shift) & 0xff);
+}
+
+static void writeChunk(FILE *file, const char *type, const vector<unsigned char> &data)
+{
+  vector<unsigned char> chunk;
+  writeBigEndian(chunk, data.size());
+  chunk.insert(chunk.end(), type, type + 4);
+  chunk.insert(chunk.end(), data.begin(), data.end());
+  writeBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+  fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+// Write an RGB image as PNG using uncompressed deflate blocks (fast and without dependency on zlib)
+static void writePNG(FILE *file, int width, int height, const vector<unsigned char> &rows)
+{
+  static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  fwrite(signature, 1, sizeof(signature), file);
+
+  vector<unsigned char> header;
+  writeBigEndian(header, width);
+  writeBigEndian(header, height);
+  header.insert(header.end(), {8, 2, 0, 0, 0});
+  writeChunk(file, "IHDR", header);
+
+  vector<unsigned char> data = {0x78, 0x01};
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (size_t offset=0; offset<rows.size(); offset+=65535) {
+    size_t size = min(rows.size() - offset, (size_t)65535);
+    data.push_back(offset + size == rows.size() ? 1 : 0);
+    data.insert(data.end(), {(unsigned char)(size & 0xff), (unsigned char)(size >> 8),
+                             (unsigned char)(~size & 0xff), (unsigned char)((~size >> 8) & 0xff)});
+    data.insert(data.end(), rows.begin() + offset, rows.begin() + offset + size);
+    for (size_t i=offset; i<offset+size; i++) {
+      a = (a + rows[i]) % 65521;
+      b = (b + a) % 65521;
+    };
+  };
+  writeBigEndian(data, (b << 16) | a);
+  writeChunk(file, "IDAT", data);
+  writeChunk(file, "IEND", vector<unsigned char>());
+}
+
+// The file name pattern is passed to snprintf, so it must contain exactly one integer conversion ("%d" with an optional
+// zero flag and width) and no other "%"
+static bool framePattern(const string &pattern)
+{
+  size_t i = pattern.find('%') + 1;
+  if (i < pattern.size() && pattern[i] == '0')
+    i++;
+  while (i < pattern.size() && isdigit((unsigned char)pattern[i]))
+    i++;
+  return i < pattern.size() && pattern[i] == 'd' && pattern.find('%', i) == string::npos;
+}
+
+Capture::Capture(const Options &options, int width, int height):
+  target(options.getString("capture", "")), width(width), height(height),
+  frames(options.getInt("capture-frames", 600)), fps(options.getDouble("capture-fps", 60.0)), egl(options.has("egl")),
+  output(nullptr), pipe(false), fbo(0), color(0), depth(0), queued(0), retrieved(0), written(0),
+  capacity(max(options.getInt("capture-queue", 8), 1)), drop(options.has("capture-drop")), head(0), count(0), lost(0),
+  waited(0.0), stopping(false)
+{
+  if (!enabled())
+    return;
+  if (target[0] == '|') {
+    pipe = true;
+    output = popen(target.c_str() + 1, "w");
+  } else if (target.find('%') == string::npos)
+    output = fopen(target.c_str(), "wb");
+  else if (!framePattern(target)) {
+    cerr << "Capture file name pattern " << target << " needs exactly one %d conversion (e.g. frame%05d.png)" << endl;
+    target.clear();
+    return;
+  };
+  if (output == nullptr && (pipe || target.find('%') == string::npos)) {
+    cerr << "Could not open capture target " << target << endl;
+    target.clear();
+    return;
+  };
+  queue.resize((size_t)capacity * width * height * 3);
+  numbers.resize(capacity);
+  writer = thread(&Capture::run, this);
+}
+
+Capture::~Capture()
+{
+  stop();
+  if (output != nullptr) {
+    if (pipe)
+      pclose(output);
+    else
+      fclose(output);
+  };
+}
+
+void Capture::hints() const
+{
+  if (!enabled())
+    return;
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  if (egl)
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+}
+
+void Capture::init()
+{
+  if (!enabled())
+    return;
+  glGenRenderbuffers(1, &color);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    cerr << "Capture framebuffer is incomplete" << endl;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  glGenBuffers(cNumBuffers, pbo);
+  for (int i=0; i<cNumBuffers; i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 3, NULL, GL_STREAM_READ);
+    fence[i] = 0;
+  };
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+}
+
+void Capture::beginFrame()
+{
+  if (!enabled())
+    return;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, width, height);
+}
+
+void Capture::endFrame()
+{
+  if (!enabled())
+    return;
+  int slot = queued % cNumBuffers;
+  // Slot still holds the frame from cNumBuffers frames ago which should have arrived by now
+  retrieve(slot);
+  if (queued < frames) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, (void *)0);
+    fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    queued++;
+  };
+
+  // Show the frame in the window as well in case it is visible
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Capture::finish()
+{
+  if (!enabled())
+    return;
+  for (int i=0; i<cNumBuffers; i++)
+    retrieve((queued + i) % cNumBuffers);
+  glDeleteBuffers(cNumBuffers, pbo);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteRenderbuffers(1, &depth);
+  glDeleteRenderbuffers(1, &color);
+  stop();
+  cerr << "Captured " << written << " frames of size " << width << "x" << height << " at " << fps << " fps" << endl;
+  if (lost > 0)
+    cerr << "Capture queue overflowed, " << lost << " frames were dropped (increase --capture-queue)" << endl;
+  if (waited > 0.0)
+    cerr << "The render loop waited " << waited << " ms for the capture writer" << endl;
+}
+
+void Capture::retrieve(int slot)
+{
+  if (fence[slot] == 0)
+    return;
+  glClientWaitSync(fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fence[slot]);
+  fence[slot] = 0;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+  size_t size = (size_t)width * height * 3;
+  const unsigned char *pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+  {
+    unique_lock<std::mutex> lock(queue_mutex);
+    if (count == capacity && !drop) {
+      auto start = chrono::steady_clock::now();
+      space.wait(lock, [this]{ return count < capacity; });
+      waited += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    if (count == capacity)
+      lost++;
+    else {
+      int index = (head + count) % capacity;
+      copy(pixels, pixels + size, queue.begin() + index * size);
+      numbers[index] = retrieved;
+      count++;
+    };
+  }
+  ready.notify_one();
+  retrieved++;
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void Capture::run()
+{
+  size_t size = (size_t)width * height * 3;
+  while (true) {
+    int slot;
+    {
+      unique_lock<std::mutex> lock(queue_mutex);
+      ready.wait(lock, [this]{ return stopping || count > 0; });
+      if (count == 0)
+        break;
+      slot = head;
+    }
+    // The render thread only fills the slots behind the queued frames, so the frame at the head is written unlocked
+    writeFrame(queue.data() + slot * size, numbers[slot]);
+    {
+      lock_guard<std::mutex> lock(queue_mutex);
+      head = (head + 1) % capacity;
+      count--;
+    }
+    space.notify_one();
+  };
+  if (output != nullptr)
+    fflush(output);
+}
+
+void Capture::stop()
+{
+  if (!writer.joinable())
+    return;
+  {
+    lock_guard<std::mutex> lock(queue_mutex);
+    stopping = true;
+  }
+  ready.notify_one();
+  writer.join();
+}
+
+void Capture::writeFrame(const unsigned char *pixels, int number)
+{
+  // OpenGL returns the rows bottom up
+  size_t stride = width * 3;
+  if (output != nullptr) {
+    for (int y=height-1; y>=0; y--)
+      fwrite(pixels + y * stride, 1, stride, output);
+  } else {
+    row.resize((stride + 1) * height);
+    for (int y=0; y<height; y++) {
+      row[y * (stride + 1)] = 0;
+      copy(pixels + (height - 1 - y) * stride, pixels + (height - y) * stride, row.begin() + y * (stride + 1) + 1);
+    };
+    char file_name[1024];
+    snprintf(file_name, sizeof(file_name), target.c_str(), number);
+    FILE *file = fopen(file_name, "wb");
+    if (file != nullptr) {
+      writePNG(file, width, height, row);
+      fclose(file);
+    } else
+      cerr << "Could not write " << file_name << endl;
+  };
+  written++;
+}
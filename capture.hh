@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+#include "options.hh"
+
+// Offscreen capture of rendered frames.
+//
+// The scene is rendered into a framebuffer object of fixed size. Frames are read back asynchronously using a ring of
+// pixel buffer objects and copied into a queue of "--capture-queue N" frames (8 by default) a few frames later when
+// the transfer has completed. A background thread encodes and writes them, so the render loop does no file or pipe
+// I/O and short stalls of the disk or the encoder are absorbed by the queue. When the queue is full the render loop
+// waits for the writer, since a video must not lose frames, and the total wait is reported. With "--capture-drop" the
+// frame is dropped and counted instead, so the render loop never waits. The target given with "--capture" is either a
+// pipe to an encoder ("|ffmpeg ..."), a file name pattern for PNG frames ("frame%05d.png", dropped frames leave gaps
+// in the numbers) or a file receiving raw RGB24 frames.
+class Capture
+{
+  public:
+    Capture(const Options &options, int width, int height);
+    ~Capture();
+    bool enabled() const { return !target.empty(); }
+    bool done() const { return enabled() && queued >= frames; }
+    double timestep() const { return 1.0 / fps; }
+    void hints() const;
+    void init();
+    void beginFrame();
+    void endFrame();
+    void finish();
+  private:
+    void retrieve(int slot);
+    void run();
+    void stop();
+    void writeFrame(const unsigned char *pixels, int number);
+    static const int cNumBuffers = 3;
+    std::string target;
+    int width;
+    int height;
+    int frames;
+    double fps;
+    bool egl;
+    FILE *output;
+    bool pipe;
+    GLuint fbo;
+    GLuint color;
+    GLuint depth;
+    GLuint pbo[cNumBuffers];
+    GLsync fence[cNumBuffers];
+    int queued;
+    int retrieved;
+    int written;
+    std::vector<unsigned char> row;
+    int capacity;
+    bool drop;
+    std::vector<unsigned char> queue;
+    std::vector<int> numbers;
+    int head;
+    int count;
+    int lost;
+    double waited;
+    bool stopping;
+    std::mutex queue_mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::thread writer;
+};
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <thread>
+#include <tuple>
+#include <Jolt/Physics/Body/Body.h>
+#include "contact_events.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+// Threads are numbered in the order of their first contact callback
+static atomic<size_t> sNumThreads(0);
+
+static size_t threadIndex()
+{
+  static thread_local size_t index = sNumThreads.fetch_add(1, memory_order_relaxed);
+  return index;
+}
+
+ContactEvents::ContactEvents(size_t capacity, ContactListener *next):
+  buffers(max(thread::hardware_concurrency(), 1u)), next(next), lost(0)
+{
+  for (Buffer &buffer: buffers) {
+    buffer.count = 0;
+    buffer.events.resize(capacity);
+  };
+  merged.reserve(capacity);
+}
+
+ContactEvent *ContactEvents::append()
+{
+  Buffer &buffer = buffers[threadIndex() % buffers.size()];
+  size_t index = buffer.count.fetch_add(1, memory_order_relaxed);
+  return index < buffer.events.size() ? &buffer.events[index] : nullptr;
+}
+
+void ContactEvents::record(ContactEvent::Type type, const Body &body1, const Body &body2, const ContactManifold &manifold)
+{
+  ContactEvent *event = append();
+  if (event == nullptr)
+    return;
+  RVec3 point = manifold.GetWorldSpaceContactPointOn1(0);
+  Vec3 velocity = body1.GetPointVelocity(point) - body2.GetPointVelocity(point);
+  event->type = type;
+  event->body1 = body1.GetID();
+  event->body2 = body2.GetID();
+  event->point[0] = (float)point.GetX();
+  event->point[1] = (float)point.GetY();
+  event->point[2] = (float)point.GetZ();
+  event->speed = velocity.Dot(manifold.mWorldSpaceNormal);
+  event->depth = manifold.mPenetrationDepth;
+}
+
+ValidateResult ContactEvents::OnContactValidate(const Body &inBody1, const Body &inBody2, RVec3Arg inBaseOffset,
+                                                const CollideShapeResult &inCollisionResult)
+{
+  if (next != nullptr)
+    return next->OnContactValidate(inBody1, inBody2, inBaseOffset, inCollisionResult);
+  return ValidateResult::AcceptAllContactsForThisBodyPair;
+}
+
+void ContactEvents::OnContactAdded(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold,
+                                   ContactSettings &ioSettings)
+{
+  record(ContactEvent::ADDED, inBody1, inBody2, inManifold);
+  if (next != nullptr)
+    next->OnContactAdded(inBody1, inBody2, inManifold, ioSettings);
+}
+
+void ContactEvents::OnContactPersisted(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold,
+                                       ContactSettings &ioSettings)
+{
+  record(ContactEvent::PERSISTED, inBody1, inBody2, inManifold);
+  if (next != nullptr)
+    next->OnContactPersisted(inBody1, inBody2, inManifold, ioSettings);
+}
+
+void ContactEvents::OnContactRemoved(const SubShapeIDPair &inSubShapePair)
+{
+  // The bodies may already be destroyed, only their IDs are known
+  ContactEvent *event = append();
+  if (event != nullptr)
+    *event = {ContactEvent::REMOVED, inSubShapePair.GetBody1ID(), inSubShapePair.GetBody2ID(), {0, 0, 0}, 0, 0};
+  if (next != nullptr)
+    next->OnContactRemoved(inSubShapePair);
+}
+
+const vector<ContactEvent> &ContactEvents::collect()
+{
+  merged.clear();
+  for (Buffer &buffer: buffers) {
+    size_t count = buffer.count.exchange(0, memory_order_relaxed);
+    size_t stored = min(count, buffer.events.size());
+    lost += count - stored;
+    merged.insert(merged.end(), buffer.events.begin(), buffer.events.begin() + stored);
+  };
+  // The threads pick up the body pairs in a different order every step. A body pair reports one manifold per pair of
+  // sub shapes, so the key compares all fields and only identical events remain tied.
+  sort(merged.begin(), merged.end(), [](const ContactEvent &a, const ContactEvent &b) {
+    return make_tuple(a.body1, a.body2, a.type, a.point[0], a.point[1], a.point[2], a.depth, a.speed) <
+           make_tuple(b.body1, b.body2, b.type, b.point[0], b.point[1], b.point[2], b.depth, b.speed);
+  });
+  return merged;
+}
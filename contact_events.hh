@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Collision/ContactListener.h>
+
+// Compact record of a contact callback
+struct ContactEvent
+{
+  enum Type: JPH::uint32 { ADDED, PERSISTED, REMOVED };
+  Type type;
+  JPH::BodyID body1;
+  JPH::BodyID body2;
+  // First contact point on body 1 (zero for removed contacts)
+  float point[3];
+  // Speed at which the bodies approach each other along the contact normal
+  float speed;
+  float depth;
+};
+
+// Contact listener that records events without taking locks.
+//
+// Jolt calls the contact listener from its job threads while they find the contacts of the step. Each thread appends
+// to its own preallocated buffer (threads are assigned to buffers once, threads in excess of the number of buffers
+// share them through the atomic counter), so the callbacks neither block nor share cache lines. Events which do not
+// fit into the buffer of a thread are dropped and counted. After PhysicsSystem::Update the buffers are merged and
+// sorted into a deterministic order with collect().
+//
+// Another listener can be chained, it receives all callbacks after they are recorded.
+class ContactEvents: public JPH::ContactListener
+{
+  public:
+    ContactEvents(size_t capacity = 4096, JPH::ContactListener *next = nullptr);
+    // Merge the events of the last step and empty the buffers, must not be called during PhysicsSystem::Update
+    const std::vector<ContactEvent> &collect();
+    size_t dropped() const { return lost; }
+    virtual JPH::ValidateResult OnContactValidate(const JPH::Body &inBody1, const JPH::Body &inBody2,
+                                                  JPH::RVec3Arg inBaseOffset,
+                                                  const JPH::CollideShapeResult &inCollisionResult) override;
+    virtual void OnContactAdded(const JPH::Body &inBody1, const JPH::Body &inBody2,
+                                const JPH::ContactManifold &inManifold, JPH::ContactSettings &ioSettings) override;
+    virtual void OnContactPersisted(const JPH::Body &inBody1, const JPH::Body &inBody2,
+                                    const JPH::ContactManifold &inManifold, JPH::ContactSettings &ioSettings) override;
+    virtual void OnContactRemoved(const JPH::SubShapeIDPair &inSubShapePair) override;
+  private:
+    struct alignas(64) Buffer
+    {
+      std::atomic<size_t> count;
+      std::vector<ContactEvent> events;
+    };
+    ContactEvent *append();
+    void record(ContactEvent::Type type, const JPH::Body &body1, const JPH::Body &body2,
+                const JPH::ContactManifold &manifold);
+    std::vector<Buffer> buffers;
+    std::vector<ContactEvent> merged;
+    JPH::ContactListener *next;
+    size_t lost;
+};
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "options.hh"
+#include "lockstep.hh"
+
+
+using namespace std;
+
+// Coordinator of a lockstep session: collects the inputs of all players for each step, checks the state hashes and
+// sends the inputs of all players back to everyone (see lockstep.hh)
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  string path = options.getString("socket", "/tmp/jolt-lockstep.sock");
+  int players = options.getInt("players", 2);
+  if (players < 1) {
+    cerr << "Need at least one player" << endl;
+    return 1;
+  };
+  int server = lockstepListen(path, players);
+  if (server < 0)
+    return 1;
+  cerr << "Waiting for " << players << " players on " << path << endl;
+
+  vector<int> clients;
+  while ((int)clients.size() < players) {
+    int fd = accept(server, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    LockstepHello hello;
+    if (!receiveAll(fd, &hello, sizeof(hello)) || hello.magic != cLockstepMagic) {
+      cerr << "Ignoring invalid connection" << endl;
+      close(fd);
+      continue;
+    };
+    clients.push_back(fd);
+  };
+  for (int i=0; i<players; i++) {
+    LockstepStart start = {cLockstepMagic, (uint32_t)i, (uint32_t)players, 0};
+    sendAll(clients[i], &start, sizeof(start));
+  };
+
+  vector<LockstepInput> inputs(players);
+  vector<char> message(sizeof(LockstepFrame) + players * 4 * sizeof(float));
+  vector<double> times;
+  uint32_t step = 0;
+  uint64_t desyncs = 0;
+  bool running = true;
+  while (running) {
+    // The time until all inputs have arrived is the skew between the fastest and the slowest player
+    auto start = chrono::steady_clock::now();
+    for (int i=0; i<players && running; i++) {
+      if (!receiveAll(clients[i], &inputs[i], sizeof(LockstepInput))) {
+        cerr << "Player " << i << " disconnected at step " << step << endl;
+        running = false;
+      } else if (inputs[i].step != step) {
+        cerr << "Player " << i << " sent step " << inputs[i].step << " instead of " << step << endl;
+        running = false;
+      };
+    };
+    if (!running)
+      break;
+    times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+    LockstepFrame frame = {step, 0};
+    for (int i=1; i<players; i++)
+      if (inputs[i].hash_step == inputs[0].hash_step && inputs[i].hash != inputs[0].hash)
+        frame.flags |= cLockstepDesync;
+    if (frame.flags & cLockstepDesync) {
+      if (desyncs == 0) {
+        printf("Desync of the state at step %u:\n", inputs[0].hash_step);
+        for (int i=0; i<players; i++)
+          printf("  player %d hash %016llx\n", i, (unsigned long long)inputs[i].hash);
+      };
+      desyncs++;
+    };
+    memcpy(message.data(), &frame, sizeof(frame));
+    for (int i=0; i<players; i++)
+      memcpy(message.data() + sizeof(frame) + i * 4 * sizeof(float), inputs[i].input, 4 * sizeof(float));
+    for (int i=0; i<players; i++)
+      sendAll(clients[i], message.data(), message.size());
+    step++;
+  };
+
+  if (!times.empty()) {
+    double total = 0.0;
+    for (double time: times)
+      total += time;
+    sort(times.begin(), times.end());
+    printf("%u steps with %d players, %llu desynced: waiting for inputs mean %.4f ms, p50 %.4f ms, p95 %.4f ms, max %.4f ms\n",
+           step, players, (unsigned long long)desyncs, total / times.size(), times[times.size() / 2],
+           times[times.size() * 95 / 100], times.back());
+  };
+  for (int fd: clients)
+    close(fd);
+  close(server);
+  unlink(path.c_str());
+  return desyncs > 0 ? 1 : 0;
+}
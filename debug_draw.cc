@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cstdio>
+#include <Jolt/Physics/Body/BodyManager.h>
+#include <Jolt/Physics/Constraints/ContactConstraintManager.h>
+#include "debug_draw.hh"
+#include <GLFW/glfw3.h>
+
+
+using namespace std;
+using namespace JPH;
+
+static const char *cVertexSource = "#version 410 core\n\
+uniform float aspect;\n\
+uniform float scale;\n\
+uniform vec3 offset;\n\
+uniform int swap_xz;\n\
+in vec3 point;\n\
+in vec4 color;\n\
+out vec4 c;\n\
+void main()\n\
+{\n\
+  vec3 p = (point - offset) * scale;\n\
+  if (swap_xz != 0)\n\
+    p = p.zyx;\n\
+  c = color;\n\
+  gl_Position = vec4(p * vec3(1, aspect, 1), 1);\n\
+}";
+
+static const char *cFragmentSource = "#version 410 core\n\
+in vec4 c;\n\
+out vec3 fragColor;\n\
+void main()\n\
+{\n\
+  fragColor = c.rgb;\n\
+}";
+
+static GLuint compileShader(GLenum type, const char *source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint result = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+  if (result == GL_FALSE) {
+    char buffer[1024];
+    glGetShaderInfoLog(shader, 1024, NULL, buffer);
+    fprintf(stderr, "Debug draw shader: %s\n", buffer);
+  };
+  return shader;
+}
+
+DebugDraw::DebugDraw():
+  contacts(false), constraints(false), bounds(false), islands(false), down{false, false, false, false}, capacity(0),
+  program(0), vao(0), vbo(0)
+{
+}
+
+void DebugDraw::init()
+{
+  GLuint vertex_shader = compileShader(GL_VERTEX_SHADER, cVertexSource);
+  GLuint fragment_shader = compileShader(GL_FRAGMENT_SHADER, cFragmentSource);
+  program = glCreateProgram();
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glBindAttribLocation(program, 0, "point");
+  glBindAttribLocation(program, 1, "color");
+  glLinkProgram(program);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+  glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glBindVertexArray(0);
+}
+
+bool DebugDraw::toggle(GLFWwindow *window, int key, bool &key_down)
+{
+  bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+  bool result = pressed && !key_down;
+  key_down = pressed;
+  return result;
+}
+
+void DebugDraw::handleKeys(GLFWwindow *window)
+{
+  if (toggle(window, GLFW_KEY_C, down[0]))
+    contacts = !contacts;
+  if (toggle(window, GLFW_KEY_J, down[1]))
+    constraints = !constraints;
+  if (toggle(window, GLFW_KEY_B, down[2]))
+    bounds = !bounds;
+  if (toggle(window, GLFW_KEY_I, down[3]))
+    islands = !islands;
+  // Contacts are drawn by the contact constraint manager during the physics step
+  ContactConstraintManager::sDrawContactPoint = contacts;
+  ContactConstraintManager::sDrawContactManifolds = contacts;
+}
+
+void DebugDraw::drawPhysics(PhysicsSystem &physics_system, RVec3Arg camera)
+{
+  SetCameraPos(camera);
+  if (bounds || islands) {
+    BodyManager::DrawSettings settings;
+    settings.mDrawShape = islands;
+    settings.mDrawShapeWireframe = true;
+    settings.mDrawShapeColor = BodyManager::EShapeColor::IslandColor;
+    settings.mDrawBoundingBox = bounds;
+    physics_system.DrawBodies(settings, this);
+  };
+  if (constraints) {
+    physics_system.DrawConstraints(this);
+    physics_system.DrawConstraintReferenceFrame(this);
+    physics_system.DrawConstraintLimits(this);
+  };
+}
+
+void DebugDraw::addVertex(vector<Vertex> &vertices, RVec3Arg position, ColorArg color)
+{
+  vertices.push_back({{(float)position.GetX(), (float)position.GetY(), (float)position.GetZ()},
+                      {color.r, color.g, color.b, color.a}});
+}
+
+// Contact points are drawn from the job threads of the physics step
+void DebugDraw::DrawLine(RVec3Arg from, RVec3Arg to, ColorArg color)
+{
+  lock_guard<std::mutex> lock(vertex_mutex);
+  addVertex(lines, from, color);
+  addVertex(lines, to, color);
+}
+
+void DebugDraw::DrawTriangle(RVec3Arg v1, RVec3Arg v2, RVec3Arg v3, ColorArg color, ECastShadow cast_shadow)
+{
+  lock_guard<std::mutex> lock(vertex_mutex);
+  addVertex(triangles, v1, color);
+  addVertex(triangles, v2, color);
+  addVertex(triangles, v3, color);
+}
+
+void DebugDraw::DrawText3D(RVec3Arg position, const string_view &text, ColorArg color, float height)
+{
+}
+
+void DebugDraw::draw(const float offset[3], float scale, float aspect, bool swap_xz)
+{
+  if (lines.empty() && triangles.empty())
+    return;
+  // Triangles are followed by the lines in the same buffer, which is orphaned and grown as needed
+  size_t size = (triangles.size() + lines.size()) * sizeof(Vertex);
+  glUseProgram(program);
+  glUniform1f(glGetUniformLocation(program, "aspect"), aspect);
+  glUniform1f(glGetUniformLocation(program, "scale"), scale);
+  glUniform3fv(glGetUniformLocation(program, "offset"), 1, offset);
+  glUniform1i(glGetUniformLocation(program, "swap_xz"), swap_xz ? 1 : 0);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  capacity = max(capacity, size);
+  glBufferData(GL_ARRAY_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, triangles.size() * sizeof(Vertex), triangles.data());
+  glBufferSubData(GL_ARRAY_BUFFER, triangles.size() * sizeof(Vertex), lines.size() * sizeof(Vertex), lines.data());
+  if (!triangles.empty())
+    glDrawArrays(GL_TRIANGLES, 0, triangles.size());
+  if (!lines.empty()) {
+    glDisable(GL_DEPTH_TEST);
+    glDrawArrays(GL_LINES, triangles.size(), lines.size());
+    glEnable(GL_DEPTH_TEST);
+  };
+  glBindVertexArray(0);
+  lines.clear();
+  triangles.clear();
+  NextFrame();
+}
+
+void DebugDraw::finish()
+{
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteProgram(program);
+}
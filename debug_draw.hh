@@ -0,0 +1,56 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Renderer/DebugRendererSimple.h>
+#include <GL/glew.h>
+
+struct GLFWwindow;
+
+// Debug drawing of the physics system for builds with JPH_DEBUG_RENDERER ("make DEBUG_RENDERER=1", Jolt needs to be
+// built with the debug renderer as well).
+//
+// All lines and triangles Jolt emits during a frame (including the contact points drawn by the job threads while
+// stepping, which is why the batch is guarded by a mutex) are collected in one vertex array and drawn with two draw
+// calls using the orthographic camera of the scene viewer. Lines are drawn without depth test so contacts inside of
+// bodies stay visible. Text is not supported. The layers are toggled with the keys C (contact points and manifolds),
+// J (constraint reference frames and limits), B (bounding boxes used by the broad phase) and I (shapes colored by
+// simulation island).
+class DebugDraw: public JPH::DebugRendererSimple
+{
+  public:
+    DebugDraw();
+    void init();
+    void handleKeys(GLFWwindow *window);
+    // Draw the enabled layers of the physics system into the batch
+    void drawPhysics(JPH::PhysicsSystem &physics_system, JPH::RVec3Arg camera);
+    // Draw and clear the batch
+    void draw(const float offset[3], float scale, float aspect, bool swap_xz);
+    void finish();
+    virtual void DrawLine(JPH::RVec3Arg from, JPH::RVec3Arg to, JPH::ColorArg color) override;
+    virtual void DrawTriangle(JPH::RVec3Arg v1, JPH::RVec3Arg v2, JPH::RVec3Arg v3, JPH::ColorArg color,
+                              ECastShadow cast_shadow = ECastShadow::Off) override;
+    virtual void DrawText3D(JPH::RVec3Arg position, const std::string_view &text, JPH::ColorArg color,
+                            float height) override;
+  private:
+    struct Vertex
+    {
+      float position[3];
+      JPH::uint8 color[4];
+    };
+    void addVertex(std::vector<Vertex> &vertices, JPH::RVec3Arg position, JPH::ColorArg color);
+    bool toggle(GLFWwindow *window, int key, bool &key_down);
+    bool contacts;
+    bool constraints;
+    bool bounds;
+    bool islands;
+    bool down[4];
+    std::vector<Vertex> lines;
+    std::vector<Vertex> triangles;
+    std::mutex vertex_mutex;
+    size_t capacity;
+    GLuint program;
+    GLuint vao;
+    GLuint vbo;
+};
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <GLFW/glfw3.h>
+#include "frame_pacer.hh"
+
+
+using namespace std;
+
+// The limiter yields instead of sleeping for the last part of a frame as sleeps may overshoot by this much
+static const chrono::microseconds cSpinTime(500);
+
+static double milliseconds(chrono::steady_clock::duration duration)
+{
+  return chrono::duration<double, milli>(duration).count();
+}
+
+static void printRow(const char *name, vector<double> &times)
+{
+  sort(times.begin(), times.end());
+  size_t n = times.size();
+  printf("  %-8s %8.3f %8.3f %8.3f %8.3f ms\n", name, times[n / 2], times[n * 95 / 100], times[n * 99 / 100], times.back());
+  times.clear();
+}
+
+FramePacer::FramePacer(const Options &options):
+  interval(options.has("uncapped") ? 0 : options.getInt("vsync", 1)),
+  fps(options.has("uncapped") ? 0.0 : options.getDouble("fps", 0.0)),
+  stats_interval(options.getDouble("frame-stats", 0.0)), swap_time(0.0), physics_time(0.0)
+{
+}
+
+void FramePacer::init()
+{
+  glfwSwapInterval(interval);
+  frame_start = Clock::now();
+  deadline = frame_start;
+  report_start = frame_start;
+}
+
+void FramePacer::swapBuffers(GLFWwindow *window)
+{
+  Clock::time_point start = Clock::now();
+  glfwSwapBuffers(window);
+  swap_time += milliseconds(Clock::now() - start);
+}
+
+void FramePacer::beginPhysics()
+{
+  physics_start = Clock::now();
+}
+
+void FramePacer::endPhysics()
+{
+  physics_time += milliseconds(Clock::now() - physics_start);
+}
+
+void FramePacer::endFrame()
+{
+  double work = milliseconds(Clock::now() - frame_start);
+  if (fps > 0.0)
+    wait();
+  Clock::time_point now = Clock::now();
+  if (stats_interval > 0.0) {
+    frame_times.push_back(milliseconds(now - frame_start));
+    render_times.push_back(max(work - swap_time - physics_time, 0.0));
+    swap_times.push_back(swap_time);
+    physics_times.push_back(physics_time);
+    if (chrono::duration<double>(now - report_start).count() >= stats_interval)
+      report();
+  };
+  frame_start = now;
+  swap_time = 0.0;
+  physics_time = 0.0;
+}
+
+void FramePacer::wait()
+{
+  if (Clock::now() < deadline - cSpinTime)
+    this_thread::sleep_until(deadline - cSpinTime);
+  while (Clock::now() < deadline)
+    this_thread::yield();
+  // Keep the phase when a frame was late by less than one period, otherwise start over from now
+  Clock::duration period = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / fps));
+  Clock::time_point now = Clock::now();
+  deadline += period;
+  if (deadline < now)
+    deadline = now + period;
+}
+
+void FramePacer::report()
+{
+  Clock::time_point now = Clock::now();
+  double seconds = chrono::duration<double>(now - report_start).count();
+  printf("%zu frames in %.2f s, %.1f fps\n", frame_times.size(), seconds, frame_times.size() / seconds);
+  printf("  %-8s %8s %8s %8s %8s\n", "", "p50", "p95", "p99", "max");
+  printRow("frame", frame_times);
+  printRow("render", render_times);
+  printRow("swap", swap_times);
+  printRow("physics", physics_times);
+  fflush(stdout);
+  report_start = now;
+}
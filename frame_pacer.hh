@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include "options.hh"
+
+struct GLFWwindow;
+
+// Frame pacing and frame time statistics of the render loop.
+//
+// "--vsync N" sets the swap interval (1 by default, 0 disables vertical sync), "--uncapped" disables vertical sync and
+// the limiter and "--fps N" limits the frame rate. The limiter sleeps until shortly before the deadline of the frame
+// and only yields the processor for the remaining fraction of a millisecond, so it does not burn a core.
+//
+// With "--frame-stats SECONDS" the 50th, 95th and 99th percentile and the maximum of the frame time and its parts
+// (render: CPU time of the loop outside the swap and the physics step, swap: time blocked in the buffer swap, physics:
+// time of the physics step) are printed periodically for the frames of the last interval.
+class FramePacer
+{
+  public:
+    FramePacer(const Options &options);
+    // Set the swap interval, the OpenGL context needs to be current
+    void init();
+    void swapBuffers(GLFWwindow *window);
+    void beginPhysics();
+    void endPhysics();
+    // Wait for the deadline of the frame when limiting the frame rate and update the statistics
+    void endFrame();
+  private:
+    typedef std::chrono::steady_clock Clock;
+    void wait();
+    void report();
+    int interval;
+    double fps;
+    double stats_interval;
+    Clock::time_point frame_start;
+    Clock::time_point deadline;
+    Clock::time_point report_start;
+    Clock::time_point physics_start;
+    double swap_time;
+    double physics_time;
+    std::vector<double> frame_times;
+    std::vector<double> render_times;
+    std::vector<double> swap_times;
+    std::vector<double> physics_times;
+};
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "lockstep.hh"
+
+
+using namespace std;
+
+static bool socketAddress(const string &path, sockaddr_un &address)
+{
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    cerr << "Socket path " << path << " is too long" << endl;
+    return false;
+  };
+  strcpy(address.sun_path, path.c_str());
+  return true;
+}
+
+int lockstepListen(const string &path, int backlog)
+{
+  sockaddr_un address;
+  if (!socketAddress(path, address))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    cerr << "Could not create socket: " << strerror(errno) << endl;
+    return -1;
+  };
+  unlink(path.c_str());
+  if (bind(fd, (sockaddr *)&address, sizeof(address)) != 0 || listen(fd, backlog) != 0) {
+    cerr << "Could not listen on " << path << ": " << strerror(errno) << endl;
+    close(fd);
+    return -1;
+  };
+  return fd;
+}
+
+int lockstepConnect(const string &path)
+{
+  sockaddr_un address;
+  if (!socketAddress(path, address))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    cerr << "Could not create socket: " << strerror(errno) << endl;
+    return -1;
+  };
+  if (connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+    cerr << "Could not connect to " << path << ": " << strerror(errno) << endl;
+    close(fd);
+    return -1;
+  };
+  return fd;
+}
+
+bool sendAll(int fd, const void *data, size_t size)
+{
+  const char *pointer = (const char *)data;
+  while (size > 0) {
+    ssize_t sent = send(fd, pointer, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      return false;
+    pointer += sent;
+    size -= sent;
+  };
+  return true;
+}
+
+bool receiveAll(int fd, void *data, size_t size)
+{
+  char *pointer = (char *)data;
+  while (size > 0) {
+    ssize_t received = recv(fd, pointer, size, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return false;
+    pointer += received;
+    size -= received;
+  };
+  return true;
+}
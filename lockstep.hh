@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Deterministic lockstep over a Unix domain socket.
+//
+// Every player runs the same scene and only the driver inputs are exchanged through a coordinator process. A player
+// connects and sends a LockstepHello, the coordinator answers with a LockstepStart once all players are connected.
+// Afterwards each player sends one LockstepInput per step (the inputs for a step are sent a fixed number of steps
+// ahead to hide the latency) together with the hash of its state at an earlier step. The coordinator collects the
+// inputs of all players for a step, compares the hashes and sends a LockstepFrame followed by the four input values of
+// every player to all players. All values are in host byte order as the processes run on the same machine.
+static const uint32_t cLockstepMagic = 0x4b434c4a; // "JLCK"
+
+// Flag of a frame if the state hashes of the players differ
+static const uint32_t cLockstepDesync = 1;
+
+struct LockstepHello
+{
+  uint32_t magic;
+  uint32_t reserved;
+};
+
+struct LockstepStart
+{
+  uint32_t magic;
+  uint32_t player;
+  uint32_t players;
+  uint32_t reserved;
+};
+
+struct LockstepInput
+{
+  uint32_t step;
+  uint32_t hash_step;
+  uint64_t hash;
+  float input[4];
+};
+
+struct LockstepFrame
+{
+  uint32_t step;
+  uint32_t flags;
+};
+
+// Create a listening socket (replacing a stale socket file), returns -1 on failure
+int lockstepListen(const std::string &path, int backlog);
+
+// Connect to the coordinator, returns -1 on failure
+int lockstepConnect(const std::string &path);
+
+// Blocking transfer of the complete buffer, false if the connection failed or was closed
+bool sendAll(int fd, const void *data, size_t size);
+bool receiveAll(int fd, void *data, size_t size);
@@ -0,0 +1,54 @@
+#include <cstdlib>
+#include <set>
+#include "options.hh"
+
+
+using namespace std;
+
+// Options without value of all the programs
+static const set<string> cFlags = {
+  "autotune", "broadphase-stats", "capture-drop", "determinism", "egl", "impacts", "lidar", "no-cache", "no-culling",
+  "no-overlay", "no-persistent", "no-pool", "realtime", "sweep", "track-memory", "uncapped", "warm-start-test"
+};
+
+static bool isOption(const char *argument)
+{
+  return argument[0] == '-' && argument[1] == '-' && argument[2] != '\0';
+}
+
+Options::Options(int argc, char *argv[])
+{
+  for (int i=1; i<argc; i++) {
+    if (isOption(argv[i])) {
+      string name = argv[i] + 2;
+      if (!cFlags.count(name) && i + 1 < argc && !isOption(argv[i + 1]))
+        values[name] = argv[++i];
+      else
+        values[name] = "";
+    } else
+      arguments.push_back(argv[i]);
+  };
+}
+
+bool Options::has(const string &name) const
+{
+  return values.find(name) != values.end();
+}
+
+string Options::getString(const string &name, const string &fallback) const
+{
+  auto value = values.find(name);
+  return value == values.end() || value->second.empty() ? fallback : value->second;
+}
+
+int Options::getInt(const string &name, int fallback) const
+{
+  auto value = values.find(name);
+  return value == values.end() || value->second.empty() ? fallback : atoi(value->second.c_str());
+}
+
+double Options::getDouble(const string &name, double fallback) const
+{
+  auto value = values.find(name);
+  return value == values.end() || value->second.empty() ? fallback : atof(value->second.c_str());
+}
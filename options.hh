@@ -0,0 +1,23 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+// Command line options of the form "--name value" or "--name" (flag).
+// Arguments not starting with "--" are kept as positional arguments.
+// The flags are listed in options.cc and never take a value, so positional arguments may follow them. Any other option
+// takes the next argument as its value unless it starts with "--", so a positional argument directly after an option
+// which is given without its value is taken as that value.
+class Options
+{
+  public:
+    Options(int argc, char *argv[]);
+    bool has(const std::string &name) const;
+    std::string getString(const std::string &name, const std::string &fallback) const;
+    int getInt(const std::string &name, int fallback) const;
+    double getDouble(const std::string &name, double fallback) const;
+    const std::vector<std::string> &positional() const { return arguments; }
+  private:
+    std::map<std::string, std::string> values;
+    std::vector<std::string> arguments;
+};
@@ -0,0 +1,131 @@
+#include <cstdarg>
+#include <cstdio>
+#include "overlay.hh"
+
+
+using namespace std;
+
+// Glyphs of the characters 32 to 95 with 3 bits per row (top row in the highest bits, left column in the highest bit
+// of a row)
+static const unsigned short cFont[64] = {
+  0x0000, 0x2482, 0x0000, 0x5f7d, 0x0000, 0x52a5, 0x0000, 0x2400,
+  0x1491, 0x4494, 0x0aa8, 0x05d0, 0x0014, 0x01c0, 0x0002, 0x12a4,
+  0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249,
+  0x7bef, 0x7bcf, 0x0410, 0x0000, 0x1511, 0x0e38, 0x4454, 0x6282,
+  0x0000, 0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b,
+  0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a,
+  0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd,
+  0x5aad, 0x5a92, 0x72a7, 0x3493, 0x0000, 0x6496, 0x0000, 0x0007
+};
+
+static const char *cVertexSource = "#version 410 core\n\
+uniform vec2 size;\n\
+in vec2 point;\n\
+void main()\n\
+{\n\
+  gl_Position = vec4(2.0 * point.x / size.x - 1.0, 1.0 - 2.0 * point.y / size.y, 0, 1);\n\
+}";
+
+static const char *cFragmentSource = "#version 410 core\n\
+out vec3 fragColor;\n\
+void main()\n\
+{\n\
+  fragColor = vec3(1.0, 0.85, 0.2);\n\
+}";
+
+static GLuint compileShader(GLenum type, const char *source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint result = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+  if (result == GL_FALSE) {
+    char buffer[1024];
+    glGetShaderInfoLog(shader, 1024, NULL, buffer);
+    fprintf(stderr, "Overlay shader: %s\n", buffer);
+  };
+  return shader;
+}
+
+Overlay::Overlay(int width, int height, int scale):
+  width(width), height(height), scale(scale), program(0), vao(0), vbo(0)
+{
+}
+
+void Overlay::init()
+{
+  GLuint vertex_shader = compileShader(GL_VERTEX_SHADER, cVertexSource);
+  GLuint fragment_shader = compileShader(GL_FRAGMENT_SHADER, cFragmentSource);
+  program = glCreateProgram();
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  glBindAttribLocation(program, 0, "point");
+  glLinkProgram(program);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+  glUseProgram(program);
+  glUniform2f(glGetUniformLocation(program, "size"), width, height);
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+  glBindVertexArray(0);
+}
+
+void Overlay::print(const char *format, ...)
+{
+  va_list list;
+  va_start(list, format);
+  char buffer[256];
+  vsnprintf(buffer, sizeof(buffer), format, list);
+  va_end(list);
+  lines.push_back(buffer);
+}
+
+void Overlay::addGlyph(char character, int x, int y)
+{
+  if (character >= 'a' && character <= 'z')
+    character -= 'a' - 'A';
+  if (character < 32 || character >= 96)
+    return;
+  unsigned short glyph = cFont[character - 32];
+  for (int row=0; row<5; row++)
+    for (int column=0; column<3; column++) {
+      if (((glyph >> (14 - 3 * row - column)) & 1) == 0)
+        continue;
+      float x0 = x + column * scale;
+      float y0 = y + row * scale;
+      float x1 = x0 + scale;
+      float y1 = y0 + scale;
+      vertices.insert(vertices.end(), {x0, y0, x1, y0, x1, y1, x0, y0, x1, y1, x0, y1});
+    };
+}
+
+void Overlay::draw()
+{
+  vertices.clear();
+  for (size_t i=0; i<lines.size(); i++)
+    for (size_t j=0; j<lines[i].size(); j++)
+      addGlyph(lines[i][j], (2 + 4 * j) * scale, (2 + 7 * i) * scale);
+  if (vertices.empty())
+    return;
+  glDisable(GL_DEPTH_TEST);
+  glUseProgram(program);
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+  glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 2);
+  glBindVertexArray(0);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void Overlay::finish()
+{
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteProgram(program);
+}
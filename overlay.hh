@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// Text overlay drawn on top of the scene.
+//
+// Lines of text are rendered with a built-in 3x5 pixel font (digits, upper case letters and a few symbols, lower case
+// letters are shown in upper case). Each lit pixel of a glyph becomes a square of scale x scale screen pixels. The
+// quads are generated on the CPU and streamed into a vertex buffer when drawing. init() and finish() need the OpenGL
+// context to be current.
+class Overlay
+{
+  public:
+    Overlay(int width, int height, int scale = 3);
+    void init();
+    void clear() { lines.clear(); }
+    void print(const char *format, ...);
+    void draw();
+    void finish();
+  private:
+    void addGlyph(char character, int x, int y);
+    int width;
+    int height;
+    int scale;
+    std::vector<std::string> lines;
+    std::vector<float> vertices;
+    GLuint program;
+    GLuint vao;
+    GLuint vbo;
+};
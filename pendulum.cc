@@ -1,4 +1,8 @@
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
 #include <cstdarg>
 #include <thread>
 #include <Jolt/Jolt.h>
@@ -13,8 +17,17 @@
 #include <Jolt/Physics/Collision/BroadPhase/BroadPhaseLayer.h>
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <Jolt/Physics/Constraints/HingeConstraint.h>
+#include <Jolt/Physics/Constraints/PointConstraint.h>
+#include <Jolt/Physics/Constraints/SwingTwistConstraint.h>
+#include <Jolt/Physics/Constraints/DistanceConstraint.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "options.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "physics_settings.hh"
+#include "allocator.hh"
+#include "frame_pacer.hh"
 
 
 using namespace std;
@@ -154,12 +167,12 @@ GLfloat vertices[] = {
 };
 
 unsigned int indices[] = {
-   0,  1,  2,  3,
-   4,  5,  6,  7,
-   8,  9, 10, 11,
-  12, 13, 14, 15,
-  16, 17, 18, 19,
-  20, 21, 22, 23
+   0,  1,  2,  0,  2,  3,
+   4,  5,  6,  4,  6,  7,
+   8,  9, 10,  8, 10, 11,
+  12, 13, 14, 12, 14, 15,
+  16, 17, 18, 16, 18, 19,
+  20, 21, 22, 20, 22, 23
 };
 
 void handleCompileError(const char *step, GLuint shader)
@@ -186,12 +199,281 @@ void handleLinkError(const char *step, GLuint program)
   };
 }
 
-int main(void)
+const uint cNumBodyMutexes = 0;
+const uint cMaxBodyPairs = 1024;
+const uint cMaxContactConstraints = 1024;
+
+// Attachment of two bodies, the joint error is the separation of the attachment points (or the deviation from the
+// rest length for distance joints)
+struct Joint
+{
+  Body *body1;
+  Body *body2;
+  Vec3 point1;
+  Vec3 point2;
+  float distance;
+};
+
+struct Chain
+{
+  Body *base;
+  vector<Body *> links;
+  vector<Joint> joints;
+  vector<Ref<Constraint>> constraints;
+};
+
+static Vec3 localPoint(const Body &body, RVec3Arg point)
 {
+  return Vec3(body.GetWorldTransform().Inversed() * point);
+}
+
+// Create a horizontal chain of links hanging from a static base. The pivot of link i is at i * length / links.
+static bool createChain(PhysicsSystem &physics_system, const string &joint_type, int links, float length, Chain &chain)
+{
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  float a = length / links;
+  float b = min(0.05f, 0.5f * a);
+
+  BoxShapeSettings base_shape_settings(Vec3(0.1, 0.1, 0.1));
+  base_shape_settings.mConvexRadius = 0.01;
+  base_shape_settings.SetEmbedded();
+  ShapeSettings::ShapeResult base_shape_result = base_shape_settings.Create();
+  ShapeRefC base_shape = base_shape_result.Get();
+  BodyCreationSettings base_settings(base_shape, RVec3(0.0, 0.5, 0.0), Quat::sIdentity(), EMotionType::Static, Layers::MOVING);
+  chain.base = body_interface.CreateBody(base_settings);
+  body_interface.AddBody(chain.base->GetID(), EActivation::DontActivate);
+
+  BoxShapeSettings link_shape_settings(Vec3(a, b, b));
+  link_shape_settings.mConvexRadius = min(0.01f, 0.5f * b);
+  link_shape_settings.SetEmbedded();
+  ShapeSettings::ShapeResult link_shape_result = link_shape_settings.Create();
+  ShapeRefC link_shape = link_shape_result.Get();
+
+  Body *previous = chain.base;
+  for (int i=0; i<links; i++) {
+    BodyCreationSettings link_settings(link_shape, RVec3((i + 0.5) * a, 0.5, 0.0), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
+    link_settings.mApplyGyroscopicForce = true;
+    link_settings.mLinearDamping = 0.0;
+    link_settings.mAngularDamping = 0.0;
+    Body *link = body_interface.CreateBody(link_settings);
+    if (link == nullptr) {
+      cerr << "Could not create link " << i << endl;
+      return false;
+    };
+    body_interface.AddBody(link->GetID(), EActivation::Activate);
+    chain.links.push_back(link);
+
+    RVec3 pivot(i * a, 0.5, 0.0);
+    Joint joint = {previous, link, localPoint(*previous, pivot), localPoint(*link, pivot), 0.0f};
+    Ref<Constraint> constraint;
+    if (joint_type == "hinge") {
+      HingeConstraintSettings hinge;
+      hinge.mPoint1 = hinge.mPoint2 = pivot;
+      hinge.mHingeAxis1 = hinge.mHingeAxis2 = Vec3::sAxisZ();
+      hinge.mNormalAxis1 = hinge.mNormalAxis2 = Vec3::sAxisY();
+      constraint = hinge.Create(*previous, *link);
+    } else if (joint_type == "point") {
+      PointConstraintSettings point;
+      point.mPoint1 = point.mPoint2 = pivot;
+      constraint = point.Create(*previous, *link);
+    } else if (joint_type == "swing_twist") {
+      SwingTwistConstraintSettings swing_twist;
+      swing_twist.mPosition1 = swing_twist.mPosition2 = pivot;
+      swing_twist.mTwistAxis1 = swing_twist.mTwistAxis2 = Vec3::sAxisX();
+      swing_twist.mPlaneAxis1 = swing_twist.mPlaneAxis2 = Vec3::sAxisY();
+      swing_twist.mNormalHalfConeAngle = swing_twist.mPlaneHalfConeAngle = DegreesToRadians(150.0f);
+      swing_twist.mTwistMinAngle = -JPH_PI;
+      swing_twist.mTwistMaxAngle = JPH_PI;
+      constraint = swing_twist.Create(*previous, *link);
+    } else if (joint_type == "distance") {
+      // Rope of particles: the centers of consecutive links keep their distance
+      RVec3 center1 = previous == chain.base ? pivot : previous->GetCenterOfMassPosition();
+      RVec3 center2 = link->GetCenterOfMassPosition();
+      DistanceConstraintSettings distance;
+      distance.mPoint1 = center1;
+      distance.mPoint2 = center2;
+      constraint = distance.Create(*previous, *link);
+      joint.point1 = localPoint(*previous, center1);
+      joint.point2 = localPoint(*link, center2);
+      joint.distance = (float)(center2 - center1).Length();
+    } else {
+      cerr << "Unknown joint type " << joint_type << " (use hinge, point, swing_twist or distance)" << endl;
+      return false;
+    };
+    physics_system.AddConstraint(constraint);
+    chain.constraints.push_back(constraint);
+    chain.joints.push_back(joint);
+    previous = link;
+  };
+  return true;
+}
+
+static void destroyChain(PhysicsSystem &physics_system, Chain &chain)
+{
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  for (auto constraint=chain.constraints.begin(); constraint!=chain.constraints.end(); constraint++)
+    physics_system.RemoveConstraint(*constraint);
+  for (Body *link: chain.links) {
+    body_interface.RemoveBody(link->GetID());
+    body_interface.DestroyBody(link->GetID());
+  };
+  body_interface.RemoveBody(chain.base->GetID());
+  body_interface.DestroyBody(chain.base->GetID());
+  chain.constraints.clear();
+  chain.joints.clear();
+  chain.links.clear();
+}
+
+// Mean joint error of the chain, the largest error is returned in maximum
+static double jointError(const Chain &chain, double &maximum)
+{
+  double total = 0.0;
+  maximum = 0.0;
+  for (const Joint &joint: chain.joints) {
+    RVec3 point1 = joint.body1->GetWorldTransform() * joint.point1;
+    RVec3 point2 = joint.body2->GetWorldTransform() * joint.point2;
+    double error = fabs((point2 - point1).Length() - joint.distance);
+    total += error;
+    maximum = max(maximum, error);
+  };
+  return chain.joints.empty() ? 0.0 : total / chain.joints.size();
+}
+
+struct Measurement
+{
+  double step_time;
+  double mean_error;
+  double max_error;
+};
+
+// Simulate a chain without window and measure the step time and the joint error
+static bool simulate(const string &joint_type, int links, float length, const PhysicsSettings &settings, double dt, int steps,
+                     TempAllocator &temp_allocator, JobSystem &job_system, Measurement &measurement)
+{
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+
+  PhysicsSystem physics_system;
+  physics_system.Init(links + 16, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
+                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetGravity(Vec3(0, -0.4, 0));
+  physics_system.SetPhysicsSettings(settings);
+  Chain chain;
+  if (!createChain(physics_system, joint_type, links, length, chain))
+    return false;
+  physics_system.OptimizeBroadPhase();
+
+  measurement.step_time = 0.0;
+  measurement.mean_error = 0.0;
+  measurement.max_error = 0.0;
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  for (int step=0; step<steps; step++) {
+    body_interface.ActivateBody(chain.links[0]->GetID());
+    auto start = chrono::steady_clock::now();
+    physics_system.Update(dt, 1, &temp_allocator, &job_system);
+    measurement.step_time += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double maximum;
+    measurement.mean_error += jointError(chain, maximum);
+    measurement.max_error = max(measurement.max_error, maximum);
+  };
+  measurement.step_time /= max(steps, 1);
+  measurement.mean_error /= max(steps, 1);
+
+  destroyChain(physics_system, chain);
+  return true;
+}
+
+static void printHeader()
+{
+  printf("%12s %7s %9s %9s %12s %14s %14s\n", "joint", "links", "velocity", "position", "step/ms", "mean error/m", "max error/m");
+}
+
+static void printMeasurement(const string &joint_type, int links, const PhysicsSettings &settings, const Measurement &measurement)
+{
+  printf("%12s %7d %9u %9u %12.4f %14.3e %14.3e\n", joint_type.c_str(), links, settings.mNumVelocitySteps, settings.mNumPositionSteps,
+         measurement.step_time, measurement.mean_error, measurement.max_error);
+}
+
+// Sweep over joint types and solver iterations for the given chain length
+static void sweep(int links, float length, PhysicsSettings settings, double dt, int steps, TempAllocator &temp_allocator,
+                  JobSystem &job_system)
+{
+  const char *joint_types[] = {"hinge", "point", "swing_twist", "distance"};
+  const int velocity_steps[] = {2, 5, 10, 20, 40};
+  const int position_steps[] = {1, 2, 4, 8};
+  printHeader();
+  for (const char *joint_type: joint_types)
+    for (int velocity: velocity_steps)
+      for (int position: position_steps) {
+        settings.mNumVelocitySteps = velocity;
+        settings.mNumPositionSteps = position;
+        Measurement measurement;
+        if (simulate(joint_type, links, length, settings, dt, steps, temp_allocator, job_system, measurement))
+          printMeasurement(joint_type, links, settings, measurement);
+      };
+}
+
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  width = options.getInt("width", width);
+  height = options.getInt("height", height);
+  string joint_type = options.getString("joint", "hinge");
+  int links = options.getInt("links", 2);
+  float length = options.getDouble("length", 1.0);
+  if (links < 1 || length <= 0.0f) {
+    cerr << "The chain needs at least one link and a positive length" << endl;
+    return 1;
+  };
+  if (joint_type != "hinge" && joint_type != "point" && joint_type != "swing_twist" && joint_type != "distance") {
+    cerr << "Unknown joint type " << joint_type << " (use hinge, point, swing_twist or distance)" << endl;
+    return 1;
+  };
+  Capture capture(options, width, height);
+
+  registerAllocator(options);
+  Trace = TraceImpl;
+  JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
+  Factory::sInstance = new Factory();
+  RegisterTypes();
+
+  TempAllocatorMalloc temp_allocator;
+  JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
+
+  PhysicsSettings settings = physicsSettings(options);
+
+  if (options.has("sweep") || options.has("steps")) {
+    double dt = options.getDouble("dt", 1.0 / 60.0);
+    int steps = options.getInt("steps", 600);
+    if (options.has("sweep"))
+      sweep(links, length, settings, dt, steps, temp_allocator, job_system);
+    else {
+      Measurement measurement;
+      if (simulate(joint_type, links, length, settings, dt, steps, temp_allocator, job_system, measurement)) {
+        printHeader();
+        printMeasurement(joint_type, links, settings, measurement);
+      };
+    };
+    printMemoryReport(cout);
+    UnregisterTypes();
+    delete Factory::sInstance;
+    Factory::sInstance = nullptr;
+    return 0;
+  };
+
   glfwInit();
-  GLFWwindow *window = glfwCreateWindow(width, height, "Double pendulum with Jolt Physics", NULL, NULL);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  capture.hints();
+  GLFWwindow *window = glfwCreateWindow(width, height, "Pendulum with Jolt Physics", NULL, NULL);
   glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
   glewInit();
+  capture.init();
+  FramePacer pacer(options);
 
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
@@ -209,6 +491,8 @@ int main(void)
   GLuint program = glCreateProgram();
   glAttachShader(program, vertexShader);
   glAttachShader(program, fragmentShader);
+  glBindAttribLocation(program, 0, "point");
+  glBindAttribLocation(program, 1, "normal");
   glLinkProgram(program);
   handleLinkError("Shader program", program);
 
@@ -244,90 +528,43 @@ int main(void)
   float light[3] = {0.36f, 0.8f, -0.48f};
   glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
   glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  float a = 0.5;
-  float b = 0.05;
-  float c = 0.05;
-  float axes[3] = {(float)a, (float)b, (float)c};
+  float a = length / links;
+  float b = min(0.05f, 0.5f * a);
+  float axes[3] = {a, b, b};
   glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
 
-  RegisterDefaultAllocator();
-  Trace = TraceImpl;
-  JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
-  Factory::sInstance = new Factory();
-  RegisterTypes();
-
-  TempAllocatorMalloc temp_allocator;
-  JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
-
-  const uint cMaxBodies = 1024;
-  const uint cNumBodyMutexes = 0;
-  const uint cMaxBodyPairs = 1024;
-  const uint cMaxContactConstraints = 1024;
   BPLayerInterfaceImpl broad_phase_layer_interface;
   ObjectLayerPairFilterImpl object_vs_object_layer_filter;
   ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
 
   PhysicsSystem physics_system;
-  physics_system.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
-                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  initPhysicsSystem(physics_system, links + 16, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                    broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
   physics_system.SetGravity(Vec3(0, -0.4, 0));
+  physics_system.SetPhysicsSettings(settings);
   BodyInterface &body_interface = physics_system.GetBodyInterface();
 
-  BoxShapeSettings base_shape_settings(Vec3(0.1, 0.1, 0.1));
-  base_shape_settings.mConvexRadius = 0.01;
-  base_shape_settings.SetEmbedded();
-  ShapeSettings::ShapeResult base_shape_result = base_shape_settings.Create();
-  ShapeRefC base_shape = base_shape_result.Get();
-  BodyCreationSettings base_settings(base_shape, RVec3(0.0, 0.5, 0.0), Quat::sIdentity(), EMotionType::Static, Layers::MOVING);
-  Body *base = body_interface.CreateBody(base_settings);
-  body_interface.AddBody(base->GetID(), EActivation::DontActivate);
-
-  vector<Body *> pendulum;
-
-  BoxShapeSettings upper_shape_settings(Vec3(a, b, c));
-  upper_shape_settings.mConvexRadius = 0.01;
-  upper_shape_settings.SetEmbedded();
-  ShapeSettings::ShapeResult upper_shape_result = upper_shape_settings.Create();
-  ShapeRefC upper_shape = upper_shape_result.Get();
-  BodyCreationSettings upper_settings(upper_shape, RVec3(0.5 * a, 0.5, 0.0), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
-  upper_settings.mApplyGyroscopicForce = true;
-  upper_settings.mLinearDamping = 0.0;
-  upper_settings.mAngularDamping = 0.0;
-  Body *upper = body_interface.CreateBody(upper_settings);
-  body_interface.AddBody(upper->GetID(), EActivation::Activate);
-  pendulum.push_back(upper);
-
-  BoxShapeSettings lower_shape_settings(Vec3(a, b, c));
-  lower_shape_settings.mConvexRadius = 0.01;
-  lower_shape_settings.SetEmbedded();
-  ShapeSettings::ShapeResult lower_shape_result = lower_shape_settings.Create();
-  ShapeRefC lower_shape = lower_shape_result.Get();
-  BodyCreationSettings lower_settings(lower_shape, RVec3(1.5 * a, 0.5, 0.0), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
-  lower_settings.mApplyGyroscopicForce = true;
-  lower_settings.mLinearDamping = 0.0;
-  lower_settings.mAngularDamping = 0.0;
-  Body *lower = body_interface.CreateBody(lower_settings);
-  body_interface.AddBody(lower->GetID(), EActivation::Activate);
-  pendulum.push_back(lower);
-
-  HingeConstraintSettings hinge1;
-  hinge1.mPoint1 = hinge1.mPoint2 = RVec3(0.0, 0.5, 0);
-  hinge1.mHingeAxis1 = hinge1.mHingeAxis2 = Vec3::sAxisZ();
-  hinge1.mNormalAxis1 = hinge1.mNormalAxis2 = Vec3::sAxisY();
-  physics_system.AddConstraint(hinge1.Create(*base, *upper));
-
-  HingeConstraintSettings hinge2;
-  hinge2.mPoint1 = hinge2.mPoint2 = RVec3(a, 0.5, 0);
-  hinge2.mHingeAxis1 = hinge2.mHingeAxis2 = Vec3::sAxisZ();
-  hinge2.mNormalAxis1 = hinge2.mNormalAxis2 = Vec3::sAxisY();
-  physics_system.AddConstraint(hinge2.Create(*upper, *lower));
+  Chain chain;
+  if (!createChain(physics_system, joint_type, links, length, chain))
+    return 1;
+  vector<Body *> &pendulum = chain.links;
 
   physics_system.OptimizeBroadPhase();
 
+  unique_ptr<Telemetry> telemetry;
+  if (options.has("telemetry"))
+    telemetry.reset(new Telemetry(options.getString("telemetry", ""), stateColumns({"angle"})));
+  uint64 step = 0;
+  double sim_time = 0.0;
+
+  // Key M prints the memory report
+  bool memory_down = false;
+  pacer.init();
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
-    double dt = glfwGetTime() - t;
+    double dt = capture.enabled() ? capture.timestep() : glfwGetTime() - t;
 
+    capture.beginFrame();
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
     for (auto body=pendulum.begin(); body!=pendulum.end(); body++) {
@@ -340,28 +577,46 @@ int main(void)
       glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
       float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
       glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-      glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
+      glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
     };
 
-    glfwSwapBuffers(window);
+    capture.endFrame();
+    pacer.swapBuffers(window);
     glfwPollEvents();
+    bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memory && !memory_down)
+      printMemoryReport(cout);
+    memory_down = memory;
+    if (capture.done())
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
     const int cCollisionSteps = 1;
-    body_interface.ActivateBody(upper->GetID());
-    physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+    body_interface.ActivateBody(pendulum[0]->GetID());
+    {
+      MemoryScope scope(MemoryCategory::STEP);
+      pacer.beginPhysics();
+      physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+      pacer.endPhysics();
+    }
+    step++;
+    sim_time += dt;
+    if (telemetry)
+      for (uint i=0; i<pendulum.size(); i++) {
+        Vec3 axis = body_interface.GetRotation(pendulum[i]->GetID()) * Vec3::sAxisX();
+        pushBody(*telemetry, step, sim_time, i, body_interface, pendulum[i]->GetID(), {atan2(axis.GetX(), -axis.GetY())});
+      };
     t += dt;
+    pacer.endFrame();
   };
 
-  body_interface.RemoveBody(upper->GetID());
-  body_interface.RemoveBody(lower->GetID());
-  body_interface.RemoveBody(base->GetID());
-  body_interface.DestroyBody(upper->GetID());
-  body_interface.DestroyBody(lower->GetID());
-  body_interface.DestroyBody(base->GetID());
+  destroyChain(physics_system, chain);
 
+  printMemoryReport(cout);
   UnregisterTypes();
   delete Factory::sInstance;
   Factory::sInstance = nullptr;
 
+  capture.finish();
+
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &idx);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -0,0 +1,66 @@
+#include "physics_settings.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+static const struct {
+  const char *name;
+  float PhysicsSettings::*field;
+} cFloatSettings[] = {
+  {"baumgarte", &PhysicsSettings::mBaumgarte},
+  {"speculative-contact-distance", &PhysicsSettings::mSpeculativeContactDistance},
+  {"penetration-slop", &PhysicsSettings::mPenetrationSlop},
+  {"linear-cast-threshold", &PhysicsSettings::mLinearCastThreshold},
+  {"linear-cast-max-penetration", &PhysicsSettings::mLinearCastMaxPenetration},
+  {"max-penetration-distance", &PhysicsSettings::mMaxPenetrationDistance},
+  {"min-velocity-for-restitution", &PhysicsSettings::mMinVelocityForRestitution},
+  {"time-before-sleep", &PhysicsSettings::mTimeBeforeSleep},
+  {"point-velocity-sleep-threshold", &PhysicsSettings::mPointVelocitySleepThreshold}
+};
+
+static const struct {
+  const char *name;
+  uint PhysicsSettings::*field;
+} cIntSettings[] = {
+  {"velocity-steps", &PhysicsSettings::mNumVelocitySteps},
+  {"position-steps", &PhysicsSettings::mNumPositionSteps}
+};
+
+static const struct {
+  const char *name;
+  bool PhysicsSettings::*field;
+} cBoolSettings[] = {
+  {"warm-start", &PhysicsSettings::mConstraintWarmStart},
+  {"body-pair-cache", &PhysicsSettings::mUseBodyPairContactCache},
+  {"manifold-reduction", &PhysicsSettings::mUseManifoldReduction},
+  {"large-island-splitter", &PhysicsSettings::mUseLargeIslandSplitter},
+  {"allow-sleeping", &PhysicsSettings::mAllowSleeping},
+  {"check-active-edges", &PhysicsSettings::mCheckActiveEdges},
+  {"deterministic", &PhysicsSettings::mDeterministicSimulation}
+};
+
+PhysicsSettings physicsSettings(const Options &options)
+{
+  PhysicsSettings settings;
+  for (auto &setting: cFloatSettings)
+    settings.*setting.field = options.getDouble(setting.name, settings.*setting.field);
+  for (auto &setting: cIntSettings)
+    settings.*setting.field = options.getInt(setting.name, settings.*setting.field);
+  for (auto &setting: cBoolSettings)
+    settings.*setting.field = options.getInt(setting.name, settings.*setting.field ? 1 : 0) != 0;
+  return settings;
+}
+
+void printPhysicsSettings(ostream &stream, const PhysicsSettings &settings)
+{
+  const char *separator = "";
+  for (auto &setting: cIntSettings) {
+    stream << separator << "--" << setting.name << " " << settings.*setting.field;
+    separator = " ";
+  };
+  for (auto &setting: cFloatSettings)
+    stream << separator << "--" << setting.name << " " << settings.*setting.field;
+  for (auto &setting: cBoolSettings)
+    stream << separator << "--" << setting.name << " " << (settings.*setting.field ? 1 : 0);
+}
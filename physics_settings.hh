@@ -0,0 +1,17 @@
+#pragma once
+#include <ostream>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+#include "options.hh"
+
+// Runtime access to the solver settings of Jolt.
+//
+// Every field of PhysicsSettings listed in physics_settings.cc can be overridden on the command line, e.g.
+// "--velocity-steps 6 --position-steps 1 --baumgarte 0.3 --speculative-contact-distance 0.01 --warm-start 0".
+// Boolean settings take 0 or 1.
+
+// The default settings of Jolt overridden by the command line options
+JPH::PhysicsSettings physicsSettings(const Options &options);
+
+// Print all settings which can be set on the command line in the form of command line options
+void printPhysicsSettings(std::ostream &stream, const JPH::PhysicsSettings &settings);
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <Jolt/Core/Color.h>
+#include <Jolt/Physics/Body/BodyFilter.h>
+#include <Jolt/Physics/Body/BodyLock.h>
+#include <Jolt/Physics/Collision/BroadPhase/BroadPhaseLayer.h>
+#include <Jolt/Physics/Collision/ObjectLayer.h>
+#include <Jolt/Physics/Collision/RayCast.h>
+#include <Jolt/Physics/Collision/CastResult.h>
+#include <Jolt/Physics/Collision/ShapeCast.h>
+#include <Jolt/Physics/Collision/CollisionCollectorImpl.h>
+#include <Jolt/Physics/Collision/NarrowPhaseQuery.h>
+#include "queries.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+QueryBatch::QueryBatch(size_t batch_size): batch_size(max(batch_size, (size_t)1))
+{
+}
+
+void QueryBatch::clear()
+{
+  queries.clear();
+}
+
+void QueryBatch::reserve(size_t size)
+{
+  queries.reserve(size);
+  hits.reserve(size);
+}
+
+void QueryBatch::addRay(RVec3Arg origin, Vec3Arg direction)
+{
+  queries.push_back({RMat44::sTranslation(origin), direction, nullptr});
+}
+
+void QueryBatch::addShapeCast(const Shape *shape, RMat44Arg start, Vec3Arg direction)
+{
+  queries.push_back({start, direction, shape});
+}
+
+void QueryBatch::run(const PhysicsSystem &physics_system, JobSystem *job_system)
+{
+  hits.resize(queries.size());
+  if (job_system == nullptr || queries.size() <= batch_size) {
+    execute(physics_system, 0, queries.size());
+    return;
+  };
+  // Each job writes a separate range of the results, the calling thread helps while waiting for the barrier
+  JobSystem::Barrier *barrier = job_system->CreateBarrier();
+  for (size_t begin=0; begin<queries.size(); begin+=batch_size) {
+    size_t end = min(begin + batch_size, queries.size());
+    JobSystem::JobHandle job = job_system->CreateJob("Queries", Color::sGreen, [this, &physics_system, begin, end]() {
+      execute(physics_system, begin, end);
+    });
+    barrier->AddJob(job);
+  };
+  job_system->WaitForJobs(barrier);
+  job_system->DestroyBarrier(barrier);
+}
+
+void QueryBatch::execute(const PhysicsSystem &physics_system, size_t begin, size_t end)
+{
+  const NarrowPhaseQuery &narrow_phase = physics_system.GetNarrowPhaseQuery();
+  BroadPhaseLayerFilter broad_phase_filter;
+  ObjectLayerFilter object_layer_filter;
+  IgnoreSingleBodyFilter body_filter(ignored);
+  for (size_t i=begin; i<end; i++) {
+    const Query &query = queries[i];
+    QueryHit &hit = hits[i];
+    RVec3 origin = query.start.GetTranslation();
+    hit.point = origin + query.direction;
+    hit.normal = Vec3::sZero();
+    hit.fraction = 1.0f;
+    hit.body = BodyID();
+    if (query.shape == nullptr) {
+      RRayCast ray(origin, query.direction);
+      RayCastResult result;
+      if (narrow_phase.CastRay(ray, result, broad_phase_filter, object_layer_filter, body_filter)) {
+        hit.point = ray.GetPointOnRay(result.mFraction);
+        hit.fraction = result.mFraction;
+        hit.body = result.mBodyID;
+        BodyLockRead lock(physics_system.GetBodyLockInterfaceNoLock(), result.mBodyID);
+        if (lock.Succeeded())
+          hit.normal = lock.GetBody().GetWorldSpaceSurfaceNormal(result.mSubShapeID2, hit.point);
+      };
+    } else {
+      RShapeCast cast(query.shape, Vec3::sReplicate(1.0f), query.start, query.direction);
+      ShapeCastSettings settings;
+      ClosestHitCollisionCollector<CastShapeCollector> collector;
+      narrow_phase.CastShape(cast, settings, origin, collector, broad_phase_filter, object_layer_filter, body_filter);
+      if (collector.HadHit()) {
+        // Contact points are relative to the base offset
+        hit.point = origin + collector.mHit.mContactPointOn2;
+        hit.normal = -collector.mHit.mPenetrationAxis.NormalizedOr(Vec3::sZero());
+        hit.fraction = collector.mHit.mFraction;
+        hit.body = collector.mHit.mBodyID2;
+      };
+    };
+  };
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystem.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Collision/Shape/Shape.h>
+
+// Result of a ray or shape cast. Queries without a hit have the fraction 1 and an invalid body ID.
+struct QueryHit
+{
+  JPH::RVec3 point;
+  JPH::Vec3 normal;
+  float fraction;
+  JPH::BodyID body;
+};
+
+// Batch of ray casts and shape casts against the narrow phase of a physics system.
+//
+// The queries are split into chunks of batch_size which are run in parallel on the job system and write the closest
+// hit of every query into one contiguous array (in the order the queries were added). The batch must run between
+// physics steps as the bodies are read without locking. Shapes of shape casts are not reference counted by the batch
+// and must stay alive until the batch has run.
+class QueryBatch
+{
+  public:
+    QueryBatch(size_t batch_size = 256);
+    void clear();
+    void reserve(size_t size);
+    void addRay(JPH::RVec3Arg origin, JPH::Vec3Arg direction);
+    void addShapeCast(const JPH::Shape *shape, JPH::RMat44Arg start, JPH::Vec3Arg direction);
+    void setIgnoredBody(const JPH::BodyID &body) { ignored = body; }
+    // Run all queries, on the calling thread if the job system is null
+    void run(const JPH::PhysicsSystem &physics_system, JPH::JobSystem *job_system);
+    size_t size() const { return queries.size(); }
+    const std::vector<QueryHit> &results() const { return hits; }
+  private:
+    struct Query
+    {
+      JPH::RMat44 start;
+      JPH::Vec3 direction;
+      const JPH::Shape *shape;
+    };
+    void execute(const JPH::PhysicsSystem &physics_system, size_t begin, size_t end);
+    size_t batch_size;
+    JPH::BodyID ignored;
+    std::vector<Query> queries;
+    std::vector<QueryHit> hits;
+};
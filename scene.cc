@@ -0,0 +1,1441 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/Factory.h>
+#include <Jolt/RegisterTypes.h>
+#include <Jolt/Core/TempAllocator.h>
+#include <Jolt/Core/JobSystemThreadPool.h>
+#include <Jolt/Physics/StateRecorderImpl.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+#include <Jolt/Physics/Collision/ObjectLayer.h>
+#include <Jolt/Physics/Collision/BroadPhase/BroadPhaseLayer.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/Collision/Shape/SphereShape.h>
+#include <Jolt/Physics/Collision/ContactListener.h>
+#include <Jolt/Physics/Constraints/TwoBodyConstraint.h>
+#include <Jolt/Physics/Vehicle/WheeledVehicleController.h>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include "options.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "physics_settings.hh"
+#include "scene_file.hh"
+#include "scene_cache.hh"
+#include "allocator.hh"
+#include "frame_pacer.hh"
+#include "lockstep.hh"
+#include "queries.hh"
+#include "stream_buffer.hh"
+#include "step_stats.hh"
+#include "broadphase_policy.hh"
+#ifdef JPH_DEBUG_RENDERER
+#include "debug_draw.hh"
+#endif
+
+
+using namespace std;
+using namespace JPH;
+
+static void TraceImpl(const char *inFMT, ...)
+{
+  va_list list;
+  va_start(list, inFMT);
+  char buffer[1024];
+  vsnprintf(buffer, sizeof(buffer), inFMT, list);
+  va_end(list);
+  cerr << buffer << endl;
+}
+
+#ifdef JPH_ENABLE_ASSERTS
+
+// Callback for asserts, connect this to your own assert handler if you have one
+static bool AssertFailedImpl(const char *inExpression, const char *inMessage, const char *inFile, uint inLine)
+{
+  cerr << inFile << ":" << inLine << ": (" << inExpression << ") " << (inMessage != nullptr? inMessage : "") << endl;
+  return true;
+};
+
+#endif
+
+
+class ObjectLayerPairFilterImpl: public ObjectLayerPairFilter
+{
+  public:
+    virtual bool ShouldCollide(ObjectLayer inObject1, ObjectLayer inObject2) const override {
+      if (inObject1 == SceneLayers::GHOST || inObject2 == SceneLayers::GHOST)
+        return false;
+      return inObject1 != SceneLayers::STATIC || inObject2 != SceneLayers::STATIC;
+    }
+};
+
+namespace BroadPhaseLayers
+{
+  static constexpr BroadPhaseLayer NON_MOVING(0);
+  static constexpr BroadPhaseLayer MOVING(1);
+};
+
+class BPLayerInterfaceImpl final: public BroadPhaseLayerInterface
+{
+  public:
+    virtual uint GetNumBroadPhaseLayers() const override {
+      return 2;
+    }
+
+    virtual BroadPhaseLayer GetBroadPhaseLayer(ObjectLayer inLayer) const override {
+      return inLayer == SceneLayers::STATIC ? BroadPhaseLayers::NON_MOVING : BroadPhaseLayers::MOVING;
+    }
+
+#if defined(JPH_EXTERNAL_PROFILE) || defined(JPH_PROFILE_ENABLED)
+    virtual const char *GetBroadPhaseLayerName(BroadPhaseLayer inLayer) const override {
+      return inLayer == BroadPhaseLayers::NON_MOVING ? "NON_MOVING" : "MOVING";
+    }
+#endif
+};
+
+class ObjectVsBroadPhaseLayerFilterImpl : public ObjectVsBroadPhaseLayerFilter
+{
+public:
+  virtual bool ShouldCollide(ObjectLayer inLayer1, BroadPhaseLayer inLayer2) const override {
+    if (inLayer1 == SceneLayers::GHOST)
+      return false;
+    return inLayer1 != SceneLayers::STATIC || inLayer2 == BroadPhaseLayers::MOVING;
+  }
+};
+
+int width = 1280;
+int height = 720;
+
+const char *vertexSource = "#version 410 core\n\
+uniform float aspect;\n\
+uniform float scale;\n\
+uniform vec3 offset;\n\
+uniform int swap_xz;\n\
+in vec3 point;\n\
+in vec3 normal;\n\
+in vec3 axis_x;\n\
+in vec3 axis_y;\n\
+in vec3 axis_z;\n\
+in vec3 translation;\n\
+in vec3 axes;\n\
+out vec3 n;\n\
+void main()\n\
+{\n\
+  mat3 rotation = mat3(axis_x, axis_y, axis_z);\n\
+  vec3 p = (rotation * (point * axes) + translation - offset) * scale;\n\
+  n = rotation * normal;\n\
+  if (swap_xz != 0) {\n\
+    p = p.zyx;\n\
+    n = n.zyx;\n\
+  }\n\
+  gl_Position = vec4(p * vec3(1, aspect, 1), 1);\n\
+}";
+
+// Wheels are cylinders with the axle along the x-axis, generated from the vertex index (12 vertices per segment: two
+// triangles of the tread and one triangle of each side wall). The transform and size of every wheel come from the
+// instance attributes so all wheels are drawn with one call.
+const char *vertexWheelSource = "#version 410 core\n\
+uniform float aspect;\n\
+uniform float scale;\n\
+uniform vec3 offset;\n\
+uniform int swap_xz;\n\
+uniform int segments;\n\
+in vec3 axis_x;\n\
+in vec3 axis_y;\n\
+in vec3 axis_z;\n\
+in vec3 translation;\n\
+in vec2 size;\n\
+out vec3 n;\n\
+const int corners[12] = int[12](0, 1, 1, 0, 1, 0, -1, 1, 0, -1, 0, 1);\n\
+const float sides[12] = float[12](-1.0, -1.0, 1.0, -1.0, 1.0, 1.0, -1.0, -1.0, -1.0, 1.0, 1.0, 1.0);\n\
+void main()\n\
+{\n\
+  int segment = gl_VertexID / 12;\n\
+  int vertex = gl_VertexID % 12;\n\
+  float angle = 2.0 * 3.1415926 * float(segment + max(corners[vertex], 0)) / float(segments);\n\
+  vec3 radial = vec3(0, sin(angle), cos(angle));\n\
+  vec3 point = vec3(0.5 * size.y * sides[vertex], 0, 0);\n\
+  if (corners[vertex] >= 0)\n\
+    point += size.x * radial;\n\
+  mat3 rotation = mat3(axis_x, axis_y, axis_z);\n\
+  vec3 p = (rotation * point + translation - offset) * scale;\n\
+  n = rotation * (vertex < 6 ? radial : vec3(sides[vertex], 0, 0));\n\
+  if (swap_xz != 0) {\n\
+    p = p.zyx;\n\
+    n = n.zyx;\n\
+  }\n\
+  gl_Position = vec4(p * vec3(1, aspect, 1), 1);\n\
+}";
+
+// Boxes which are only a few pixels large on screen are drawn as points of about the same size
+const char *vertexPointSource = "#version 410 core\n\
+uniform float aspect;\n\
+uniform float scale;\n\
+uniform vec3 offset;\n\
+uniform int swap_xz;\n\
+uniform float pixels;\n\
+in vec3 translation;\n\
+in vec3 axes;\n\
+out vec3 n;\n\
+void main()\n\
+{\n\
+  vec3 p = (translation - offset) * scale;\n\
+  if (swap_xz != 0)\n\
+    p = p.zyx;\n\
+  n = vec3(0, 1, 0);\n\
+  gl_PointSize = max(length(axes) * scale * pixels, 1.0);\n\
+  gl_Position = vec4(p * vec3(1, aspect, 1), 1);\n\
+}";
+
+const char *fragmentSource = "#version 410 core\n\
+uniform vec3 light;\n\
+in vec3 n;\n\
+out vec3 fragColor;\n\
+void main()\n\
+{\n\
+  float ambient = 0.3;\n\
+  float diffuse = 0.7 * max(dot(light, n), 0);\n\
+  fragColor = vec3(1, 1, 1) * (ambient + diffuse);\n\
+}";
+
+// Vertex array data
+GLfloat vertices[] = {
+  // Front face
+  -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+   0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+   0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+  -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
+
+  // Back face
+  -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+   0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+   0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+  -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+  // Left face
+  -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+  -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+  -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+  -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+
+  // Right face
+   0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+   0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+   0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+   0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+
+  // Top face
+  -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+   0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+   0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+  -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+
+  // Bottom face
+  -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+   0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+   0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+  -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f
+};
+
+unsigned int indices[] = {
+   0,  1,  2,  0,  2,  3,
+   4,  5,  6,  4,  6,  7,
+   8,  9, 10,  8, 10, 11,
+  12, 13, 14, 12, 14, 15,
+  16, 17, 18, 16, 18, 19,
+  20, 21, 22, 20, 22, 23
+};
+
+// Per instance data of the instanced box and wheel draws
+struct InstanceTransform
+{
+  float axis_x[3];
+  float axis_y[3];
+  float axis_z[3];
+  float translation[3];
+};
+
+struct BoxInstance
+{
+  InstanceTransform transform;
+  float axes[3];
+};
+
+struct WheelInstance
+{
+  InstanceTransform transform;
+  float radius;
+  float width;
+};
+
+void handleCompileError(const char *step, GLuint shader)
+{
+  GLint result = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+  if (result == GL_FALSE) {
+    char buffer[1024];
+    glGetShaderInfoLog(shader, 1024, NULL, buffer);
+    if (buffer[0])
+      fprintf(stderr, "%s: %s\n", step, buffer);
+  };
+}
+
+void handleLinkError(const char *step, GLuint program)
+{
+  GLint result = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &result);
+  if (result == GL_FALSE) {
+    char buffer[1024];
+    glGetProgramInfoLog(program, 1024, NULL, buffer);
+    if (buffer[0])
+      fprintf(stderr, "%s: %s\n", step, buffer);
+  };
+}
+
+void storeTransform(InstanceTransform &instance, RMat44Arg transform, RVec3Arg position)
+{
+  transform.GetAxisX().StoreFloat3((Float3 *)instance.axis_x);
+  transform.GetAxisY().StoreFloat3((Float3 *)instance.axis_y);
+  transform.GetAxisZ().StoreFloat3((Float3 *)instance.axis_z);
+  instance.translation[0] = (float)position.GetX();
+  instance.translation[1] = (float)position.GetY();
+  instance.translation[2] = (float)position.GetZ();
+}
+
+// The camera is orthographic so the view volume is the clip space box, scaled by the camera scale and aspect ratio
+// (limit is its half size in view space). Returns whether the bounding box of a sphere overlaps it.
+bool inView(RVec3Arg center, float radius, RVec3Arg offset, float scale, Vec3Arg limit, bool swap_xz)
+{
+  Vec3 p = Vec3(center - offset) * scale;
+  if (swap_xz)
+    p = p.Swizzle<SWIZZLE_Z, SWIZZLE_Y, SWIZZLE_X>();
+  return Vec3::sLessOrEqual(p.Abs(), limit + Vec3::sReplicate(radius * scale)).TestAllXYZTrue();
+}
+
+// Point the instance attributes starting at the given location to the instance data at the offset of the stream buffer
+void instanceAttributes(GLuint location, size_t offset, size_t stride, int extra)
+{
+  for (int i=0; i<4; i++)
+    glVertexAttribPointer(location + i, 3, GL_FLOAT, GL_FALSE, stride, (void *)(offset + 3 * i * sizeof(float)));
+  glVertexAttribPointer(location + 4, extra, GL_FLOAT, GL_FALSE, stride,
+                        (void *)(offset + sizeof(InstanceTransform)));
+}
+
+// Run a fixed number of steps without window and report the step times
+void benchmark(const Options &options, PhysicsSystem &physics_system, TempAllocator &temp_allocator, JobSystem &job_system,
+               StepStatistics *step_stats, BroadPhasePolicy &broadphase)
+{
+  int steps = options.getInt("steps", 600);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  int collision_steps = options.getInt("collision-steps", 1);
+  vector<double> times;
+  times.reserve(steps);
+  for (int i=0; i<steps; i++) {
+    auto start = chrono::steady_clock::now();
+    {
+      MemoryScope scope(MemoryCategory::STEP);
+      if (step_stats)
+        step_stats->beginStep();
+      physics_system.Update(dt, collision_steps, &temp_allocator, &job_system);
+    }
+    times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    if (step_stats)
+      step_stats->endStep(physics_system, i + 1, (i + 1) * dt);
+    broadphase.afterStep(physics_system, times.back(), step_stats ? step_stats->collisionTime() : -1.0);
+  };
+  if (times.empty())
+    return;
+  double total = 0.0;
+  for (double time: times)
+    total += time;
+  sort(times.begin(), times.end());
+  printf("%d steps of %.6f s: mean %.4f ms, p50 %.4f ms, p95 %.4f ms, max %.4f ms, %.1f steps/s\n",
+         steps, dt, total / steps, times[steps / 2], times[steps * 95 / 100], times.back(), 1000.0 * steps / total);
+  // The peak resident size includes the scene setup, it is what a container memory limit has to cover
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("Peak resident size %.1f MiB\n", usage.ru_maxrss / 1024.0);
+}
+
+const uint cNumBodyMutexes = 0;
+const uint cMaxBodyPairs = 65536;
+const uint cMaxContactConstraints = 65536;
+
+// Records the deepest penetration of all contacts (before they are resolved by the solver)
+class PenetrationListener: public ContactListener
+{
+  public:
+    PenetrationListener(): depth(0.0f) {}
+    virtual void OnContactAdded(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold,
+                                ContactSettings &ioSettings) override {
+      record(inManifold.mPenetrationDepth);
+    }
+    virtual void OnContactPersisted(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold,
+                                    ContactSettings &ioSettings) override {
+      record(inManifold.mPenetrationDepth);
+    }
+    float take() {
+      return depth.exchange(0.0f);
+    }
+  private:
+    // The shared value is only written when it grows, so the job threads rarely contend for it
+    void record(float value) {
+      float current = depth.load(memory_order_relaxed);
+      while (value > current && !depth.compare_exchange_weak(current, value, memory_order_relaxed));
+    }
+    atomic<float> depth;
+};
+
+// Largest separation of the attachment points of hinge, point, swing twist and fixed constraints
+static double jointSeparation(const SceneInstance &instance)
+{
+  double result = 0.0;
+  for (const Ref<Constraint> &constraint: instance.constraints) {
+    EConstraintSubType type = constraint->GetSubType();
+    if (type != EConstraintSubType::Hinge && type != EConstraintSubType::Point &&
+        type != EConstraintSubType::SwingTwist && type != EConstraintSubType::Fixed)
+      continue;
+    const TwoBodyConstraint *joint = static_cast<const TwoBodyConstraint *>(constraint.GetPtr());
+    RVec3 point1 = joint->GetBody1()->GetCenterOfMassTransform() * joint->GetConstraintToBody1Matrix().GetTranslation();
+    RVec3 point2 = joint->GetBody2()->GetCenterOfMassTransform() * joint->GetConstraintToBody2Matrix().GetTranslation();
+    result = max(result, (double)(point2 - point1).Length());
+  };
+  return result;
+}
+
+// Kinetic and potential energy of all dynamic bodies
+static double mechanicalEnergy(const SceneInstance &instance, Vec3Arg gravity)
+{
+  double result = 0.0;
+  for (const Body *body: instance.bodies) {
+    if (!body->IsDynamic() || body->GetMotionProperties()->GetInverseMass() == 0.0f)
+      continue;
+    double mass = 1.0 / body->GetMotionProperties()->GetInverseMass();
+    Vec3 velocity = body->GetLinearVelocity();
+    Vec3 omega = body->GetAngularVelocity();
+    Mat44 inertia = body->GetInverseInertia().Inversed3x3();
+    result += 0.5 * mass * velocity.LengthSq() + 0.5 * omega.Dot(inertia.Multiply3x3(omega));
+    result -= mass * RVec3(gravity).Dot(body->GetCenterOfMassPosition());
+  };
+  return result;
+}
+
+struct Measurement
+{
+  double step_time;
+  double error;
+};
+
+// Simulate the scene with the given settings and measure the mean step time and the largest error
+static bool measure(const SceneFile &scene, const PhysicsSettings &settings, const string &metric, int steps, double dt,
+                    int collision_steps, TempAllocator &temp_allocator, JobSystem &job_system, Measurement &measurement)
+{
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+  PenetrationListener penetration;
+
+  PhysicsSystem physics_system;
+  physics_system.Init(scene.names.size() + 1024, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                      broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(settings);
+  if (metric == "penetration")
+    physics_system.SetContactListener(&penetration);
+  SceneInstance instance;
+  if (!createScene(scene, physics_system, instance))
+    return false;
+  physics_system.OptimizeBroadPhase();
+
+  double initial_energy = mechanicalEnergy(instance, scene.gravity);
+  measurement.step_time = 0.0;
+  measurement.error = 0.0;
+  for (int i=0; i<steps; i++) {
+    auto start = chrono::steady_clock::now();
+    physics_system.Update(dt, collision_steps, &temp_allocator, &job_system);
+    measurement.step_time += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double error;
+    if (metric == "penetration")
+      error = penetration.take();
+    else if (metric == "joint")
+      error = jointSeparation(instance);
+    else
+      error = fabs(mechanicalEnergy(instance, scene.gravity) - initial_energy) / max(fabs(initial_energy), 1e-9);
+    measurement.error = max(measurement.error, error);
+  };
+  measurement.step_time /= max(steps, 1);
+
+  destroyScene(physics_system, instance);
+  return true;
+}
+
+// Search for the cheapest solver settings which keep the error metric below the threshold
+static void autotune(const Options &options, const SceneFile &scene, TempAllocator &temp_allocator, JobSystem &job_system)
+{
+  string metric = options.getString("metric", "penetration");
+  if (metric != "penetration" && metric != "joint" && metric != "energy") {
+    cerr << "Unknown metric " << metric << " (use penetration, joint or energy)" << endl;
+    return;
+  };
+  PhysicsSettings base = physicsSettings(options);
+  // Contacts are allowed to penetrate by the penetration slop without being corrected
+  double fallback = metric == "penetration" ? 1.5 * base.mPenetrationSlop : metric == "joint" ? 0.005 : 0.01;
+  double threshold = options.getDouble("threshold", fallback);
+  int steps = options.getInt("steps", 600);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  int collision_steps = options.getInt("collision-steps", 1);
+
+  // Fewer iterations are cheaper, the Baumgarte factor only matters if there are position iterations
+  vector<PhysicsSettings> candidates;
+  const uint velocity_steps[] = {1, 2, 4, 6, 8, 10, 15, 20};
+  const uint position_steps[] = {0, 1, 2, 4};
+  const float baumgarte[] = {0.1f, 0.2f, 0.4f};
+  for (uint velocity: velocity_steps)
+    for (uint position: position_steps)
+      for (float factor: baumgarte) {
+        PhysicsSettings settings = base;
+        settings.mNumVelocitySteps = velocity;
+        settings.mNumPositionSteps = position;
+        settings.mBaumgarte = position == 0 ? base.mBaumgarte : factor;
+        candidates.push_back(settings);
+        if (position == 0)
+          break;
+      };
+
+  Measurement reference;
+  if (!measure(scene, base, metric, steps, dt, collision_steps, temp_allocator, job_system, reference))
+    return;
+  printf("%9s %9s %10s %12s %14s\n", "velocity", "position", "baumgarte", "step/ms", metric.c_str());
+  printf("%9u %9u %10.2f %12.4f %14.4e (start)\n", base.mNumVelocitySteps, base.mNumPositionSteps, base.mBaumgarte,
+         reference.step_time, reference.error);
+  bool found = false;
+  PhysicsSettings best = base;
+  Measurement cheapest = reference;
+  for (const PhysicsSettings &settings: candidates) {
+    Measurement measurement;
+    if (!measure(scene, settings, metric, steps, dt, collision_steps, temp_allocator, job_system, measurement))
+      return;
+    bool accepted = measurement.error < threshold;
+    printf("%9u %9u %10.2f %12.4f %14.4e%s\n", settings.mNumVelocitySteps, settings.mNumPositionSteps, settings.mBaumgarte,
+           measurement.step_time, measurement.error, accepted ? "" : " *");
+    if (accepted && (!found || measurement.step_time < cheapest.step_time)) {
+      found = true;
+      best = settings;
+      cheapest = measurement;
+    };
+  };
+  if (!found) {
+    printf("No setting keeps the %s error below %g\n", metric.c_str(), threshold);
+    return;
+  };
+  printf("Cheapest settings with %s error %.4e below %g, %.4f ms per step (%.1f%% of the start settings):\n",
+         metric.c_str(), cheapest.error, threshold, cheapest.step_time,
+         100.0 * cheapest.step_time / max(reference.step_time, 1e-9));
+  printPhysicsSettings(cout, best);
+  cout << endl;
+}
+
+// Restore the state of a physics system from a file written by saveStateFile
+static bool loadStateFile(PhysicsSystem &physics_system, const string &file_name)
+{
+  ifstream file(file_name, ios::binary);
+  if (!file) {
+    cerr << "Could not open state file " << file_name << endl;
+    return false;
+  };
+  stringstream buffer;
+  buffer << file.rdbuf();
+  string data = buffer.str();
+  StateRecorderImpl state;
+  state.WriteBytes(data.data(), data.size());
+  state.Rewind();
+  if (!physics_system.RestoreState(state)) {
+    cerr << "State file " << file_name << " does not match the scene" << endl;
+    return false;
+  };
+  return true;
+}
+
+// Save the full state including the contact cache and the constraint impulses used for warm starting
+static bool saveStateFile(const PhysicsSystem &physics_system, const string &file_name)
+{
+  StateRecorderImpl state;
+  physics_system.SaveState(state, EStateRecorderState::All);
+  string data = state.GetData();
+  ofstream file(file_name, ios::binary | ios::trunc);
+  file.write(data.data(), data.size());
+  if (!file) {
+    cerr << "Could not write state file " << file_name << endl;
+    return false;
+  };
+  return true;
+}
+
+// Rebuild the scene, restore the state and do one step. Returns the resulting velocities of all bodies.
+static bool stepFromState(const SceneFile &scene, StateRecorderImpl &state, const PhysicsSettings &settings, double dt,
+                          TempAllocator &temp_allocator, JobSystem &job_system, vector<Vec3> &velocities)
+{
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+
+  PhysicsSystem physics_system;
+  physics_system.Init(scene.names.size() + 1024, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                      broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(settings);
+  SceneInstance instance;
+  if (!createScene(scene, physics_system, instance))
+    return false;
+  state.Rewind();
+  bool restored = physics_system.RestoreState(state);
+  if (restored) {
+    physics_system.Update(dt, 1, &temp_allocator, &job_system);
+    velocities.clear();
+    for (const Body *body: instance.bodies) {
+      velocities.push_back(body->GetLinearVelocity());
+      velocities.push_back(body->GetAngularVelocity());
+    };
+  } else
+    cerr << "Could not restore the state into the rebuilt scene" << endl;
+  destroyScene(physics_system, instance);
+  return restored;
+}
+
+// Number of velocity iterations needed after a restore until the velocities match the converged solution
+static int iterationsToConverge(const SceneFile &scene, StateRecorderImpl &state, PhysicsSettings settings, double dt,
+                                double tolerance, int max_iterations, TempAllocator &temp_allocator, JobSystem &job_system)
+{
+  vector<Vec3> reference;
+  settings.mNumVelocitySteps = 10 * max_iterations;
+  if (!stepFromState(scene, state, settings, dt, temp_allocator, job_system, reference))
+    return -1;
+  for (int iterations=1; iterations<=max_iterations; iterations++) {
+    vector<Vec3> velocities;
+    settings.mNumVelocitySteps = iterations;
+    if (!stepFromState(scene, state, settings, dt, temp_allocator, job_system, velocities))
+      return -1;
+    float error = 0.0f;
+    for (size_t i=0; i<velocities.size(); i++)
+      error = max(error, (velocities[i] - reference[i]).Length());
+    if (error < tolerance)
+      return iterations;
+  };
+  return max_iterations + 1;
+}
+
+// Run the scene for a while and compare restoring the bodies only (cold start) with restoring the full state
+// including contact and constraint impulses (warm start)
+static void warmStartTest(const Options &options, const SceneFile &scene, TempAllocator &temp_allocator, JobSystem &job_system)
+{
+  int warmup = options.getInt("warmup", 120);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  double tolerance = options.getDouble("tolerance", 1e-4);
+  int max_iterations = options.getInt("max-iterations", 64);
+  PhysicsSettings settings = physicsSettings(options);
+
+  StateRecorderImpl cold;
+  StateRecorderImpl warm;
+  {
+    BPLayerInterfaceImpl broad_phase_layer_interface;
+    ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+    ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+
+    PhysicsSystem physics_system;
+    physics_system.Init(scene.names.size() + 1024, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                        broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+    physics_system.SetPhysicsSettings(settings);
+    SceneInstance instance;
+    if (!createScene(scene, physics_system, instance))
+      return;
+    for (int i=0; i<warmup; i++)
+      physics_system.Update(dt, 1, &temp_allocator, &job_system);
+    physics_system.SaveState(cold, EStateRecorderState(uint8(EStateRecorderState::Global) | uint8(EStateRecorderState::Bodies)));
+    physics_system.SaveState(warm, EStateRecorderState::All);
+    destroyScene(physics_system, instance);
+  }
+
+  int cold_iterations = iterationsToConverge(scene, cold, settings, dt, tolerance, max_iterations, temp_allocator, job_system);
+  int warm_iterations = iterationsToConverge(scene, warm, settings, dt, tolerance, max_iterations, temp_allocator, job_system);
+  if (cold_iterations < 0 || warm_iterations < 0)
+    return;
+  auto format = [max_iterations](int iterations) {
+    return iterations > max_iterations ? "> " + to_string(max_iterations) : to_string(iterations);
+  };
+  printf("Velocity iterations to converge within %g m/s after %d steps:\n", tolerance, warmup);
+  printf("  bodies only (cold start): %s iterations, %zu bytes of state\n", format(cold_iterations).c_str(), cold.GetDataSize());
+  printf("  full state (warm start):  %s iterations, %zu bytes of state\n", format(warm_iterations).c_str(), warm.GetDataSize());
+}
+
+// FNV-1a hash of the position, rotation and velocities of a body
+static uint64 bodyHash(const Body &body, uint64 hash = 0xcbf29ce484222325ULL)
+{
+  RVec3 position = body.GetPosition();
+  Quat rotation = body.GetRotation();
+  Vec3 linear_velocity = body.GetLinearVelocity();
+  Vec3 angular_velocity = body.GetAngularVelocity();
+  Real positions[3] = {position.GetX(), position.GetY(), position.GetZ()};
+  float values[10] = {rotation.GetX(), rotation.GetY(), rotation.GetZ(), rotation.GetW(),
+                      linear_velocity.GetX(), linear_velocity.GetY(), linear_velocity.GetZ(),
+                      angular_velocity.GetX(), angular_velocity.GetY(), angular_velocity.GetZ()};
+  auto add = [&hash](const void *data, size_t size) {
+    for (size_t i=0; i<size; i++) {
+      hash ^= ((const unsigned char *)data)[i];
+      hash *= 0x100000001b3ULL;
+    };
+  };
+  add(positions, sizeof(positions));
+  add(values, sizeof(values));
+  return hash;
+}
+
+static uint64 stateHash(const SceneInstance &instance)
+{
+  uint64 hash = 0xcbf29ce484222325ULL;
+  for (const Body *body: instance.bodies)
+    hash = bodyHash(*body, hash);
+  return hash;
+}
+
+// Simulate the scene twice side by side with separate physics systems and job systems (optionally with different
+// numbers of threads) and report the first step where the states differ
+static bool determinismCheck(const Options &options, const SceneFile &scene, TempAllocator &temp_allocator)
+{
+  int steps = options.getInt("steps", 600);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  int collision_steps = options.getInt("collision-steps", 1);
+  int threads[2];
+  threads[0] = options.getInt("threads", thread::hardware_concurrency() - 1);
+  threads[1] = options.getInt("compare-threads", threads[0]);
+  PhysicsSettings settings = physicsSettings(options);
+  if (!settings.mDeterministicSimulation)
+    cerr << "Warning: deterministic simulation is disabled" << endl;
+
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+  unique_ptr<JobSystemThreadPool> job_systems[2];
+  unique_ptr<PhysicsSystem> physics_systems[2];
+  SceneInstance instances[2];
+  bool created = true;
+  for (int run=0; run<2; run++) {
+    job_systems[run].reset(new JobSystemThreadPool(cMaxPhysicsJobs, cMaxPhysicsBarriers, threads[run]));
+    physics_systems[run].reset(new PhysicsSystem);
+    physics_systems[run]->Init(scene.names.size() + 1024, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                               broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+    physics_systems[run]->SetPhysicsSettings(settings);
+    if (created)
+      created = createScene(scene, *physics_systems[run], instances[run]);
+    if (created)
+      physics_systems[run]->OptimizeBroadPhase();
+  };
+
+  bool identical = created;
+  int step = 0;
+  while (identical && step <= steps) {
+    if (step > 0)
+      for (int run=0; run<2; run++)
+        physics_systems[run]->Update(dt, collision_steps, &temp_allocator, job_systems[run].get());
+    if (stateHash(instances[0]) != stateHash(instances[1])) {
+      identical = false;
+      printf("Runs with %d and %d threads diverge at step %d (t = %.4f s) in the bodies:\n", threads[0], threads[1], step,
+             step * dt);
+      for (size_t i=0; i<instances[0].bodies.size(); i++) {
+        const Body *body[2] = {instances[0].bodies[i], instances[1].bodies[i]};
+        if (bodyHash(*body[0]) == bodyHash(*body[1]) && body[0]->GetID() == body[1]->GetID())
+          continue;
+        RVec3 delta = body[1]->GetPosition() - body[0]->GetPosition();
+        printf("  %-16s id %u/%u position difference %.3e m\n", scene.names[i].c_str(), body[0]->GetID().GetIndex(),
+               body[1]->GetID().GetIndex(), (double)delta.Length());
+      };
+    } else
+      step++;
+  };
+  if (identical)
+    printf("Runs with %d and %d threads are identical for %d steps of %.6f s (hash %016llx)\n", threads[0], threads[1],
+           steps, dt, (unsigned long long)stateHash(instances[0]));
+
+  for (int run=0; run<2; run++)
+    destroyScene(*physics_systems[run], instances[run]);
+  return identical;
+}
+
+static void printTimes(const char *name, vector<double> times)
+{
+  if (times.empty())
+    return;
+  double total = 0.0;
+  for (double time: times)
+    total += time;
+  sort(times.begin(), times.end());
+  printf("  %-8s mean %.4f ms, p50 %.4f ms, p95 %.4f ms, p99 %.4f ms, max %.4f ms\n", name, total / times.size(),
+         times[times.size() / 2], times[times.size() * 95 / 100], times[times.size() * 99 / 100], times.back());
+}
+
+// Run the scene as one player of a lockstep session. The player steers the vehicle with its index (modulo the number
+// of vehicles) with random inputs, which only reach the other players through the coordinator.
+static bool lockstepPlayer(const Options &options, const SceneFile &scene, TempAllocator &temp_allocator,
+                           JobSystem &job_system)
+{
+  int steps = options.getInt("steps", 600);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  int delay = max(options.getInt("input-delay", 2), 1);
+  bool realtime = options.has("realtime");
+  int desync_step = options.getInt("inject-desync", -1);
+  int fd = lockstepConnect(options.getString("lockstep", ""));
+  if (fd < 0)
+    return false;
+  LockstepHello hello = {cLockstepMagic, 0};
+  LockstepStart start;
+  if (!sendAll(fd, &hello, sizeof(hello)) || !receiveAll(fd, &start, sizeof(start)) || start.magic != cLockstepMagic) {
+    cerr << "Lockstep handshake failed" << endl;
+    close(fd);
+    return false;
+  };
+
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+  PhysicsSystem physics_system;
+  physics_system.Init(scene.names.size() + 1024, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                      broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
+  SceneInstance instance;
+  if (!createScene(scene, physics_system, instance)) {
+    close(fd);
+    return false;
+  };
+  physics_system.OptimizeBroadPhase();
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  if (instance.vehicles.empty())
+    cerr << "The scene has no vehicles, the inputs are exchanged but not used" << endl;
+
+  // Random walk of the steering input
+  minstd_rand random(random_device{}());
+  uniform_real_distribution<float> change(-0.1f, 0.1f);
+  float steering = 0.0f;
+  vector<chrono::steady_clock::time_point> sent(steps);
+  auto sendInput = [&](int input_step, int hash_step) {
+    steering = min(max(steering + change(random), -1.0f), 1.0f);
+    LockstepInput input = {(uint32_t)input_step, (uint32_t)hash_step, stateHash(instance), {0.0f, steering, 0.0f, 0.0f}};
+    sent[input_step] = chrono::steady_clock::now();
+    return sendAll(fd, &input, sizeof(input));
+  };
+
+  // The first inputs are sent before the simulation starts so that the frame of each step arrives while the
+  // preceding steps are simulated
+  bool connected = true;
+  for (int i=0; i<delay && i<steps && connected; i++)
+    connected = sendInput(i, 0);
+  vector<float> inputs(start.players * 4);
+  vector<double> step_times;
+  vector<double> wait_times;
+  vector<double> latencies;
+  int desyncs = 0;
+  int step = 0;
+  auto next = chrono::steady_clock::now();
+  while (connected && step < steps) {
+    if (step + delay < steps)
+      connected = sendInput(step + delay, step);
+    auto wait_start = chrono::steady_clock::now();
+    LockstepFrame frame;
+    if (!connected || !receiveAll(fd, &frame, sizeof(frame)) || !receiveAll(fd, inputs.data(), inputs.size() * sizeof(float))) {
+      cerr << "Lost the connection to the coordinator at step " << step << endl;
+      connected = false;
+      break;
+    };
+    auto received = chrono::steady_clock::now();
+    wait_times.push_back(chrono::duration<double, milli>(received - wait_start).count());
+    latencies.push_back(chrono::duration<double, milli>(received - sent[step]).count());
+    if ((frame.flags & cLockstepDesync) != 0 && desyncs++ == 0)
+      printf("Desync reported by the coordinator in frame %u\n", frame.step);
+
+    for (uint i=0; i<start.players && !instance.vehicles.empty(); i++) {
+      VehicleConstraint *vehicle = instance.vehicles[i % instance.vehicles.size()];
+      const float *input = &inputs[i * 4];
+      static_cast<WheeledVehicleController *>(vehicle->GetController())->SetDriverInput(input[0], input[1], input[2], input[3]);
+      body_interface.ActivateBody(vehicle->GetVehicleBody()->GetID());
+    };
+    if (step == desync_step)
+      body_interface.AddLinearVelocity(instance.bodies[0]->GetID(), Vec3(0.0f, 1e-3f, 0.0f));
+    auto step_start = chrono::steady_clock::now();
+    physics_system.Update(dt, 1, &temp_allocator, &job_system);
+    step_times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - step_start).count());
+    step++;
+    if (realtime) {
+      next += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(dt));
+      this_thread::sleep_until(next);
+    };
+  };
+  close(fd);
+
+  printf("Player %u of %u: %d steps, input delay %d steps, %d desynced frames, final hash %016llx\n", start.player,
+         start.players, step, delay, desyncs, (unsigned long long)stateHash(instance));
+  printTimes("step", step_times);
+  printTimes("wait", wait_times);
+  printTimes("latency", latencies);
+  destroyScene(physics_system, instance);
+  return connected && desyncs == 0;
+}
+
+// Scan the surroundings of a body with a rotating lidar after every step. The scan runs as one batch on the job system
+// and, for comparison, with the same queries on the calling thread.
+static bool lidarBenchmark(const Options &options, const SceneFile &scene, TempAllocator &temp_allocator,
+                           JobSystem &job_system)
+{
+  int steps = options.getInt("steps", 600);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  int azimuth = options.getInt("azimuth", 1024);
+  int channels = options.getInt("channels", 16);
+  float range = options.getDouble("range", 3.0);
+  float fov = DegreesToRadians((float)options.getDouble("fov", 30.0));
+  float radius = options.getDouble("cast-radius", 0.0);
+
+  // Mount the lidar on the named body, the first vehicle or the body followed by the camera
+  int mount = scene.camera_follow;
+  if (!scene.vehicles.empty())
+    mount = scene.vehicles[0].body;
+  if (options.has("lidar-body")) {
+    auto name = find(scene.names.begin(), scene.names.end(), options.getString("lidar-body", ""));
+    if (name == scene.names.end()) {
+      cerr << "Unknown body " << options.getString("lidar-body", "") << endl;
+      return false;
+    };
+    mount = name - scene.names.begin();
+  };
+  if (mount < 0) {
+    cerr << "The scene has no vehicle, use --lidar-body to select the body carrying the lidar" << endl;
+    return false;
+  };
+
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+  PhysicsSystem physics_system;
+  physics_system.Init(scene.names.size() + 1024, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                      broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
+  SceneInstance instance;
+  if (!createScene(scene, physics_system, instance))
+    return false;
+  physics_system.OptimizeBroadPhase();
+  const Body *body = instance.bodies[mount];
+
+  // Directions of the beams in the frame of the body (y is up)
+  vector<Vec3> beams;
+  for (int i=0; i<channels; i++) {
+    float elevation = channels > 1 ? fov * ((float)i / (channels - 1) - 0.5f) : 0.0f;
+    for (int j=0; j<azimuth; j++) {
+      float angle = 2.0f * JPH_PI * j / azimuth;
+      beams.push_back(range * Vec3(cos(elevation) * sin(angle), sin(elevation), cos(elevation) * cos(angle)));
+    };
+  };
+  RefConst<Shape> sphere = radius > 0.0f ? new SphereShape(radius) : nullptr;
+  QueryBatch batch(options.getInt("batch-size", 256));
+  batch.reserve(beams.size());
+  batch.setIgnoredBody(body->GetID());
+
+  vector<double> step_times;
+  vector<double> batched_times;
+  vector<double> serial_times;
+  uint64 hits = 0;
+  uint64 mismatches = 0;
+  for (int i=0; i<steps; i++) {
+    auto start = chrono::steady_clock::now();
+    physics_system.Update(dt, 1, &temp_allocator, &job_system);
+    step_times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+    RMat44 transform = body->GetWorldTransform();
+    batch.clear();
+    for (Vec3 beam: beams) {
+      Vec3 direction = transform.Multiply3x3(beam);
+      if (sphere != nullptr)
+        batch.addShapeCast(sphere, RMat44::sTranslation(transform.GetTranslation()), direction);
+      else
+        batch.addRay(transform.GetTranslation(), direction);
+    };
+    start = chrono::steady_clock::now();
+    batch.run(physics_system, &job_system);
+    batched_times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    vector<QueryHit> batched = batch.results();
+
+    start = chrono::steady_clock::now();
+    batch.run(physics_system, nullptr);
+    serial_times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    for (size_t j=0; j<batched.size(); j++) {
+      if (batched[j].body != batch.results()[j].body || batched[j].fraction != batch.results()[j].fraction)
+        mismatches++;
+      if (!batched[j].body.IsInvalid())
+        hits++;
+    };
+  };
+  destroyScene(physics_system, instance);
+
+  printf("Lidar on %s: %zu %s per scan (%d x %d), %d steps, %.1f%% hits, %llu mismatches between batched and serial\n",
+         scene.names[mount].c_str(), beams.size(), sphere != nullptr ? "sphere casts" : "rays", azimuth, channels, steps,
+         100.0 * hits / max((double)beams.size() * steps, 1.0), (unsigned long long)mismatches);
+  printTimes("step", step_times);
+  printTimes("batched", batched_times);
+  printTimes("serial", serial_times);
+  double batched_total = 0.0;
+  for (double time: batched_times)
+    batched_total += time;
+  printf("  %.2f million queries per second in batches\n", beams.size() * steps / max(batched_total, 1e-9) * 1e-3);
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  if (options.positional().empty()) {
+    cerr << "Usage: " << argv[0] << " <scene file> [options]" << endl;
+    return 1;
+  };
+  width = options.getInt("width", width);
+  height = options.getInt("height", height);
+
+  registerAllocator(options);
+  Trace = TraceImpl;
+  JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
+  Factory::sInstance = new Factory();
+  RegisterTypes();
+
+  // The cache is kept next to the scene file unless specified otherwise
+  string cache_name = options.has("no-cache") ? "" : options.getString("cache", options.positional()[0] + ".cache");
+  auto start = chrono::steady_clock::now();
+  SceneFile scene;
+  bool cached;
+  bool loaded;
+  {
+    MemoryScope scope(MemoryCategory::SHAPES);
+    loaded = loadScene(options.positional()[0], cache_name, scene, cached);
+  }
+  if (!loaded) {
+    UnregisterTypes();
+    delete Factory::sInstance;
+    Factory::sInstance = nullptr;
+    return 1;
+  };
+  cerr << "Loaded " << scene.names.size() << " bodies, " << scene.physics->GetConstraints().size() << " constraints and "
+       << scene.vehicles.size() << " vehicles in "
+       << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms"
+       << (cached ? " from cache" : "") << endl;
+
+  setMemoryCategory(MemoryCategory::TEMP);
+  TempAllocatorImpl temp_allocator(64 * 1024 * 1024);
+  setMemoryCategory(MemoryCategory::OTHER);
+  JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, options.getInt("threads", thread::hardware_concurrency() - 1));
+
+  if (options.has("autotune") || options.has("warm-start-test") || options.has("determinism") || options.has("lockstep") ||
+      options.has("lidar")) {
+    bool result = true;
+    if (options.has("autotune"))
+      autotune(options, scene, temp_allocator, job_system);
+    else if (options.has("warm-start-test"))
+      warmStartTest(options, scene, temp_allocator, job_system);
+    else if (options.has("determinism"))
+      result = determinismCheck(options, scene, temp_allocator);
+    else if (options.has("lockstep"))
+      result = lockstepPlayer(options, scene, temp_allocator, job_system);
+    else
+      result = lidarBenchmark(options, scene, temp_allocator, job_system);
+    printMemoryReport(cout);
+    UnregisterTypes();
+    delete Factory::sInstance;
+    Factory::sInstance = nullptr;
+    return result ? 0 : 1;
+  };
+
+  const uint cMaxBodies = scene.names.size() + 1024;
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+
+  PhysicsSystem physics_system;
+  initPhysicsSystem(physics_system, cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                    broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
+  SceneInstance instance;
+  bool created;
+  {
+    MemoryScope scope(MemoryCategory::BODIES);
+    created = createScene(scene, physics_system, instance);
+  }
+  if (!created)
+    return 1;
+  physics_system.OptimizeBroadPhase();
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  if (options.has("load-state") && !loadStateFile(physics_system, options.getString("load-state", "")))
+    return 1;
+
+  unique_ptr<StepStatistics> step_stats;
+  if (options.has("step-stats")) {
+    step_stats.reset(new StepStatistics(options.getString("step-stats", ""), cMaxContactConstraints));
+    step_stats->attach(physics_system);
+  };
+
+  BroadPhasePolicy broadphase(options);
+
+  if (options.has("steps")) {
+    benchmark(options, physics_system, temp_allocator, job_system, step_stats.get(), broadphase);
+  } else {
+    Capture capture(options, width, height);
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    capture.hints();
+    GLFWwindow *window = glfwCreateWindow(width, height, ("Scene " + options.positional()[0] + " with Jolt Physics").c_str(), NULL, NULL);
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    glewInit();
+    capture.init();
+    FramePacer pacer(options);
+
+    glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
+    glViewport(0, 0, width, height);
+
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(vertexShader);
+    handleCompileError("Vertex shader", vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(fragmentShader);
+    handleCompileError("Fragment shader", fragmentShader);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, 0, "point");
+    glBindAttribLocation(program, 1, "normal");
+    glBindAttribLocation(program, 2, "axis_x");
+    glBindAttribLocation(program, 3, "axis_y");
+    glBindAttribLocation(program, 4, "axis_z");
+    glBindAttribLocation(program, 5, "translation");
+    glBindAttribLocation(program, 6, "axes");
+    glLinkProgram(program);
+    handleLinkError("Shader program", program);
+
+    GLuint vao;
+    GLuint vbo;
+    GLuint idx;
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glGenBuffers(1, &idx);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glUseProgram(program);
+
+    glVertexAttribPointer(glGetAttribLocation(program, "point"),
+                          3, GL_FLOAT, GL_FALSE,
+                          6 * sizeof(float), (void *)0);
+    glVertexAttribPointer(glGetAttribLocation(program, "normal"),
+                          3, GL_FLOAT, GL_FALSE,
+                          6 * sizeof(float), (void *)(3 * sizeof(float)));
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    for (int i=2; i<7; i++) {
+      glVertexAttribDivisor(i, 1);
+      glEnableVertexAttribArray(i);
+    };
+
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+
+    float light[3] = {0.36f, 0.8f, -0.48f};
+    glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
+    glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
+    glUniform1f(glGetUniformLocation(program, "scale"), scene.camera_scale);
+    glUniform1i(glGetUniformLocation(program, "swap_xz"), scene.camera_swap_xz ? 1 : 0);
+
+    GLuint vertexWheelShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexWheelShader, 1, &vertexWheelSource, NULL);
+    glCompileShader(vertexWheelShader);
+    handleCompileError("Wheel vertex shader", vertexWheelShader);
+
+    GLuint programWheel = glCreateProgram();
+    glAttachShader(programWheel, vertexWheelShader);
+    glAttachShader(programWheel, fragmentShader);
+    glBindAttribLocation(programWheel, 0, "axis_x");
+    glBindAttribLocation(programWheel, 1, "axis_y");
+    glBindAttribLocation(programWheel, 2, "axis_z");
+    glBindAttribLocation(programWheel, 3, "translation");
+    glBindAttribLocation(programWheel, 4, "size");
+    glLinkProgram(programWheel);
+    handleLinkError("Wheel shader program", programWheel);
+
+    const int cWheelSegments = 16;
+    glUseProgram(programWheel);
+    glUniform3fv(glGetUniformLocation(programWheel, "light"), 1, light);
+    glUniform1f(glGetUniformLocation(programWheel, "aspect"), (float)width / (float)height);
+    glUniform1f(glGetUniformLocation(programWheel, "scale"), scene.camera_scale);
+    glUniform1i(glGetUniformLocation(programWheel, "swap_xz"), scene.camera_swap_xz ? 1 : 0);
+    glUniform1i(glGetUniformLocation(programWheel, "segments"), cWheelSegments);
+
+    // The wheels only have per instance attributes
+    GLuint vaoWheel;
+    glGenVertexArrays(1, &vaoWheel);
+    glBindVertexArray(vaoWheel);
+    for (int i=0; i<5; i++) {
+      glVertexAttribDivisor(i, 1);
+      glEnableVertexAttribArray(i);
+    };
+
+    GLuint vertexPointShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexPointShader, 1, &vertexPointSource, NULL);
+    glCompileShader(vertexPointShader);
+    handleCompileError("Point vertex shader", vertexPointShader);
+
+    GLuint programPoint = glCreateProgram();
+    glAttachShader(programPoint, vertexPointShader);
+    glAttachShader(programPoint, fragmentShader);
+    glBindAttribLocation(programPoint, 0, "translation");
+    glBindAttribLocation(programPoint, 1, "axes");
+    glLinkProgram(programPoint);
+    handleLinkError("Point shader program", programPoint);
+
+    glUseProgram(programPoint);
+    glUniform3fv(glGetUniformLocation(programPoint, "light"), 1, light);
+    glUniform1f(glGetUniformLocation(programPoint, "aspect"), (float)width / (float)height);
+    glUniform1f(glGetUniformLocation(programPoint, "scale"), scene.camera_scale);
+    glUniform1i(glGetUniformLocation(programPoint, "swap_xz"), scene.camera_swap_xz ? 1 : 0);
+    glUniform1f(glGetUniformLocation(programPoint, "pixels"), 0.5f * width);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+
+    // The points read the translation and size of the box instances as vertex attributes
+    GLuint vaoPoint;
+    glGenVertexArrays(1, &vaoPoint);
+    glBindVertexArray(vaoPoint);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    // Moving bodies are drawn as their bounding boxes, bodies outside of the view are culled using their bounding
+    // spheres and boxes smaller than lod_pixels on screen are drawn as points
+    vector<Body *> drawn;
+    vector<AABox> bounds;
+    vector<float> radii;
+    for (Body *body: instance.bodies)
+      if (!body->IsStatic()) {
+        drawn.push_back(body);
+        bounds.push_back(body->GetShape()->GetLocalBounds());
+        radii.push_back(bounds.back().GetExtent().Length());
+      };
+    bool culling = !options.has("no-culling");
+    float lod_pixels = options.getDouble("lod-pixels", 4.0);
+    float pixel_scale = scene.camera_scale * width;
+    Vec3 limit(1.0f, (float)height / (float)width, 1.0f);
+    size_t num_wheels = 0;
+    for (VehicleConstraint *vehicle: instance.vehicles)
+      num_wheels += vehicle->GetWheels().size();
+
+    // The transforms of the boxes followed by the ones of the wheels are written into the stream buffer every frame
+    size_t wheel_offset = drawn.size() * sizeof(BoxInstance);
+    size_t instance_size = wheel_offset + num_wheels * sizeof(WheelInstance);
+    StreamBuffer instances(GL_ARRAY_BUFFER, instance_size, !options.has("no-persistent"));
+    instances.init();
+#ifdef JPH_DEBUG_RENDERER
+    DebugDraw debug_draw;
+    debug_draw.init();
+#endif
+
+    unique_ptr<Telemetry> telemetry;
+    if (options.has("telemetry"))
+      telemetry.reset(new Telemetry(options.getString("telemetry", ""), stateColumns()));
+    uint64 step = 0;
+    double sim_time = 0.0;
+
+    // Key S stores a branch point, key R restores it including the warm start impulses
+    StateRecorderImpl branch;
+    bool has_branch = false;
+    bool save_down = false;
+    bool restore_down = false;
+    // Key M prints the memory report
+    bool memory_down = false;
+
+    pacer.init();
+    double t = glfwGetTime();
+    while (!glfwWindowShouldClose(window)) {
+      double dt = capture.enabled() ? capture.timestep() : glfwGetTime() - t;
+      capture.beginFrame();
+      glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+      bool save = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+      if (save && !save_down) {
+        branch.Clear();
+        physics_system.SaveState(branch, EStateRecorderState::All);
+        has_branch = true;
+      };
+      save_down = save;
+      bool restore = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+      if (restore && !restore_down && has_branch) {
+        branch.Rewind();
+        physics_system.RestoreState(branch);
+      };
+      restore_down = restore;
+      bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+      if (memory && !memory_down)
+        printMemoryReport(cout);
+      memory_down = memory;
+#ifdef JPH_DEBUG_RENDERER
+      debug_draw.handleKeys(window);
+#endif
+
+      RVec3 offset = scene.camera_follow >= 0 ? instance.bodies[scene.camera_follow]->GetPosition() : RVec3(scene.camera_offset);
+      float camera[3] = {(float)offset.GetX(), (float)offset.GetY(), (float)offset.GetZ()};
+      // Boxes fill the box instances from the start and points from the end. The bodies are read directly, no other
+      // thread accesses them between the physics steps.
+      char *data = (char *)instances.map();
+      BoxInstance *boxes = (BoxInstance *)data;
+      size_t num_boxes = 0;
+      size_t num_points = 0;
+      for (uint i=0; i<drawn.size(); i++) {
+        RMat44 transform = drawn[i]->GetWorldTransform();
+        RVec3 center = transform * bounds[i].GetCenter();
+        if (culling && !inView(center, radii[i], offset, scene.camera_scale, limit, scene.camera_swap_xz))
+          continue;
+        BoxInstance *box = radii[i] * pixel_scale < lod_pixels ? &boxes[drawn.size() - ++num_points] : &boxes[num_boxes++];
+        storeTransform(box->transform, transform, center);
+        bounds[i].GetSize().StoreFloat3((Float3 *)box->axes);
+      };
+      WheelInstance *wheels = (WheelInstance *)(data + wheel_offset);
+      size_t num_visible_wheels = 0;
+      for (VehicleConstraint *vehicle: instance.vehicles)
+        for (uint i=0; i<vehicle->GetWheels().size(); i++) {
+          const WheelSettings *settings = vehicle->GetWheel(i)->GetSettings();
+          RMat44 transform = vehicle->GetWheelWorldTransform(i, Vec3::sAxisX(), Vec3::sAxisZ());
+          float radius = Vec3(0.5f * settings->mWidth, settings->mRadius, 0.0f).Length();
+          RVec3 center = transform.GetTranslation();
+          if (culling && !inView(center, radius, offset, scene.camera_scale, limit, scene.camera_swap_xz))
+            continue;
+          WheelInstance *wheel = &wheels[num_visible_wheels++];
+          storeTransform(wheel->transform, transform, center);
+          wheel->radius = settings->mRadius;
+          wheel->width = settings->mWidth;
+        };
+      size_t base = instances.unmap(instance_size);
+      glBindBuffer(GL_ARRAY_BUFFER, instances.buffer());
+
+      if (num_boxes > 0) {
+        glUseProgram(program);
+        glBindVertexArray(vao);
+        glUniform3fv(glGetUniformLocation(program, "offset"), 1, camera);
+        instanceAttributes(2, base, sizeof(BoxInstance), 3);
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0, num_boxes);
+      };
+      if (num_points > 0) {
+        size_t first = base + (drawn.size() - num_points) * sizeof(BoxInstance);
+        glUseProgram(programPoint);
+        glBindVertexArray(vaoPoint);
+        glUniform3fv(glGetUniformLocation(programPoint, "offset"), 1, camera);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+                              (void *)(first + offsetof(InstanceTransform, translation)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BoxInstance), (void *)(first + offsetof(BoxInstance, axes)));
+        glDrawArrays(GL_POINTS, 0, num_points);
+      };
+      if (num_visible_wheels > 0) {
+        glUseProgram(programWheel);
+        glBindVertexArray(vaoWheel);
+        glUniform3fv(glGetUniformLocation(programWheel, "offset"), 1, camera);
+        instanceAttributes(0, base + wheel_offset, sizeof(WheelInstance), 2);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 12 * cWheelSegments, num_visible_wheels);
+      };
+      instances.fence();
+#ifdef JPH_DEBUG_RENDERER
+      debug_draw.drawPhysics(physics_system, offset);
+      debug_draw.draw(camera, scene.camera_scale, (float)width / (float)height, scene.camera_swap_xz);
+#endif
+
+      capture.endFrame();
+      pacer.swapBuffers(window);
+      glfwPollEvents();
+      if (capture.done())
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+      const int cCollisionSteps = 1;
+      double step_time;
+      {
+        MemoryScope scope(MemoryCategory::STEP);
+        pacer.beginPhysics();
+        if (step_stats)
+          step_stats->beginStep();
+        auto start = chrono::steady_clock::now();
+        physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+        step_time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        pacer.endPhysics();
+      }
+      step++;
+      sim_time += dt;
+      if (step_stats)
+        step_stats->endStep(physics_system, step, sim_time);
+      broadphase.afterStep(physics_system, step_time, step_stats ? step_stats->collisionTime() : -1.0);
+      if (telemetry)
+        for (uint i=0; i<drawn.size(); i++)
+          pushBody(*telemetry, step, sim_time, i, body_interface, drawn[i]->GetID());
+      t += dt;
+      pacer.endFrame();
+    };
+
+    capture.finish();
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &idx);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &vbo);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteVertexArrays(1, &vaoWheel);
+    glDeleteVertexArrays(1, &vaoPoint);
+    if (instances.stalls() > 0)
+      cerr << "Waited " << instances.stalls() << " times for the GPU to release the instance buffer" << endl;
+    instances.finish();
+#ifdef JPH_DEBUG_RENDERER
+    debug_draw.finish();
+#endif
+
+    glDeleteProgram(program);
+    glDeleteProgram(programWheel);
+    glDeleteProgram(programPoint);
+    glDeleteShader(vertexShader);
+    glDeleteShader(vertexWheelShader);
+    glDeleteShader(vertexPointShader);
+    glDeleteShader(fragmentShader);
+
+    glfwTerminate();
+  };
+
+  if (options.has("save-state"))
+    saveStateFile(physics_system, options.getString("save-state", ""));
+  if (step_stats)
+    step_stats->printSummary();
+  broadphase.printSummary();
+  printMemoryReport(cout);
+  destroyScene(physics_system, instance);
+
+  UnregisterTypes();
+  delete Factory::sInstance;
+  Factory::sInstance = nullptr;
+  return 0;
+}
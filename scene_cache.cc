@@ -0,0 +1,200 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Jolt/Core/StreamIn.h>
+#include <Jolt/Core/StreamWrapper.h>
+#include <Jolt/Physics/Vehicle/WheeledVehicleController.h>
+#include "scene_cache.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+static const char cMagic[4] = {'J', 'S', 'C', 'C'};
+// The key only covers the scene text and the Jolt build. Increment the version whenever the parser produces a different
+// scene from the same text or the layout of the file changes, otherwise old caches are loaded silently.
+// 2: a vehicle of a body on a grid is added to every copy
+// 3: vehicles have differentials and an engine torque, the controller settings are stored
+static const uint32 cVersion = 3;
+
+// Stream reading from a memory mapped file, every read copies the bytes out of the mapping
+class MemoryStreamIn: public StreamIn
+{
+  public:
+    MemoryStreamIn(const char *data, size_t size): data(data), size(size), position(0), eof(false) {}
+    virtual void ReadBytes(void *outData, size_t inNumBytes) override {
+      if (inNumBytes > size - position) {
+        memset(outData, 0, inNumBytes);
+        position = size;
+        eof = true;
+        return;
+      };
+      memcpy(outData, data + position, inNumBytes);
+      position += inNumBytes;
+    }
+    virtual bool IsEOF() const override { return eof; }
+    virtual bool IsFailed() const override { return eof; }
+  private:
+    const char *data;
+    size_t size;
+    size_t position;
+    bool eof;
+};
+
+uint64 sceneKey(const string &text)
+{
+  uint64 hash = 0xcbf29ce484222325ULL;
+  auto add = [&hash](const void *data, size_t size) {
+    for (size_t i=0; i<size; i++) {
+      hash ^= ((const unsigned char *)data)[i];
+      hash *= 0x100000001b3ULL;
+    };
+  };
+  uint32 build[4] = {JPH_VERSION_MAJOR, JPH_VERSION_MINOR, JPH_VERSION_PATCH, (uint32)sizeof(Real)};
+  add(build, sizeof(build));
+  add(text.data(), text.size());
+  return hash;
+}
+
+bool loadSceneCache(const string &cache_name, uint64 key, SceneFile &scene)
+{
+  int fd = open(cache_name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return false;
+  };
+  size_t size = info.st_size;
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return false;
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  MemoryStreamIn stream((const char *)mapping, size);
+  char magic[4];
+  uint32 version = 0;
+  uint64 stored_key = 0;
+  stream.ReadBytes(magic, sizeof(magic));
+  stream.Read(version);
+  stream.Read(stored_key);
+  bool result = false;
+  if (!stream.IsFailed() && memcmp(magic, cMagic, sizeof(magic)) == 0 && version == cVersion && stored_key == key) {
+    stream.Read(scene.gravity);
+    stream.Read(scene.camera_scale);
+    stream.Read(scene.camera_offset);
+    stream.Read(scene.camera_follow);
+    stream.Read(scene.camera_swap_xz);
+    uint32 num_names = 0;
+    stream.Read(num_names);
+    scene.names.resize(stream.IsFailed() ? 0 : num_names);
+    for (string &name: scene.names)
+      stream.Read(name);
+    uint32 num_vehicles = 0;
+    stream.Read(num_vehicles);
+    scene.vehicles.resize(stream.IsFailed() ? 0 : num_vehicles);
+    for (SceneFile::Vehicle &vehicle: scene.vehicles) {
+      stream.Read(vehicle.body);
+      stream.ReadBytes(vehicle.input, sizeof(vehicle.input));
+      vehicle.settings = new VehicleConstraintSettings;
+      vehicle.settings->mController = new WheeledVehicleControllerSettings;
+      stream.Read(vehicle.settings->mMaxPitchRollAngle);
+      vehicle.settings->mController->RestoreBinaryState(stream);
+      uint32 num_wheels = 0;
+      stream.Read(num_wheels);
+      for (uint32 i=0; i<num_wheels && !stream.IsFailed(); i++) {
+        WheelSettingsWV *wheel = new WheelSettingsWV;
+        wheel->RestoreBinaryState(stream);
+        vehicle.settings->mWheels.push_back(wheel);
+      };
+    };
+    if (!stream.IsFailed()) {
+      PhysicsScene::PhysicsSceneResult physics = PhysicsScene::sRestoreFromBinaryState(stream);
+      if (physics.IsValid()) {
+        scene.physics = physics.Get();
+        result = true;
+      } else
+        cerr << "Could not restore scene cache " << cache_name << ": " << physics.GetError() << endl;
+    };
+  };
+  munmap(mapping, size);
+  return result;
+}
+
+bool saveSceneCache(const string &cache_name, uint64 key, const SceneFile &scene)
+{
+  // Write to a temporary file first so that concurrent processes never see a partial cache
+  string temporary = cache_name + ".tmp" + to_string(getpid());
+  {
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file) {
+      cerr << "Could not write scene cache " << cache_name << endl;
+      return false;
+    };
+    StreamOutWrapper stream(file);
+    stream.WriteBytes(cMagic, sizeof(cMagic));
+    stream.Write(cVersion);
+    stream.Write(key);
+    stream.Write(scene.gravity);
+    stream.Write(scene.camera_scale);
+    stream.Write(scene.camera_offset);
+    stream.Write(scene.camera_follow);
+    stream.Write(scene.camera_swap_xz);
+    stream.Write((uint32)scene.names.size());
+    for (const string &name: scene.names)
+      stream.Write(name);
+    stream.Write((uint32)scene.vehicles.size());
+    for (const SceneFile::Vehicle &vehicle: scene.vehicles) {
+      stream.Write(vehicle.body);
+      stream.WriteBytes(vehicle.input, sizeof(vehicle.input));
+      stream.Write(vehicle.settings->mMaxPitchRollAngle);
+      vehicle.settings->mController->SaveBinaryState(stream);
+      stream.Write((uint32)vehicle.settings->mWheels.size());
+      for (const WheelSettings *wheel: vehicle.settings->mWheels)
+        wheel->SaveBinaryState(stream);
+    };
+    scene.physics->SaveBinaryState(stream, true, true);
+    file.flush();
+    if (stream.IsFailed()) {
+      cerr << "Could not write scene cache " << cache_name << endl;
+      file.close();
+      remove(temporary.c_str());
+      return false;
+    };
+  }
+  if (rename(temporary.c_str(), cache_name.c_str()) != 0) {
+    remove(temporary.c_str());
+    return false;
+  };
+  return true;
+}
+
+bool loadScene(const string &file_name, const string &cache_name, SceneFile &scene, bool &cached)
+{
+  string source;
+  cached = false;
+  if (!SceneFile::read(file_name, source))
+    return false;
+  uint64 key = sceneKey(source);
+  if (!cache_name.empty()) {
+    if (loadSceneCache(cache_name, key, scene)) {
+      scene.text = source;
+      cached = true;
+      return true;
+    };
+    // Discard a partially restored scene
+    scene = SceneFile();
+  };
+  if (!scene.parse(source, file_name))
+    return false;
+  if (!cache_name.empty())
+    saveSceneCache(cache_name, key, scene);
+  return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+#include <Jolt/Jolt.h>
+#include "scene_file.hh"
+
+// Binary cache of parsed scenes.
+//
+// Creating shapes (in particular convex hulls and height fields) dominates the startup time of larger scenes. The cache
+// stores the parsed scene including the created shapes using the binary state serialisation of Jolt. The file starts
+// with the magic "JSCC", a format version (which also changes with the output of the parser) and a 64-bit key which is
+// the FNV-1a hash of the scene text combined with the Jolt version and the floating point precision (the binary state
+// is not portable between builds). The file is memory mapped when reading, which avoids reading it into a buffer first,
+// but the shapes are still deserialised by copying every value out of the mapping (restoring them saves the cooking,
+// not the copying).
+JPH::uint64 sceneKey(const std::string &text);
+
+// Restore a scene from the cache, fails if the file is missing, outdated or damaged
+bool loadSceneCache(const std::string &cache_name, JPH::uint64 key, SceneFile &scene);
+
+// Write the scene to the cache (atomically replacing an existing file)
+bool saveSceneCache(const std::string &cache_name, JPH::uint64 key, const SceneFile &scene);
+
+// Load a scene from the cache if it is up to date, otherwise parse the scene file and update the cache.
+// An empty cache name disables the cache.
+bool loadScene(const std::string &file_name, const std::string &cache_name, SceneFile &scene, bool &cached);
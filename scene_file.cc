@@ -0,0 +1,702 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/Collision/Shape/SphereShape.h>
+#include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
+#include <Jolt/Physics/Collision/Shape/CylinderShape.h>
+#include <Jolt/Physics/Collision/Shape/ConvexHullShape.h>
+#include <Jolt/Physics/Collision/Shape/HeightFieldShape.h>
+#include <Jolt/Physics/Constraints/HingeConstraint.h>
+#include <Jolt/Physics/Constraints/PointConstraint.h>
+#include <Jolt/Physics/Constraints/FixedConstraint.h>
+#include <Jolt/Physics/Constraints/SliderConstraint.h>
+#include <Jolt/Physics/Constraints/DistanceConstraint.h>
+#include <Jolt/Physics/Constraints/SwingTwistConstraint.h>
+#include <Jolt/Physics/Vehicle/WheeledVehicleController.h>
+#include <Jolt/Physics/Vehicle/VehicleCollisionTester.h>
+#include "scene_file.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+static bool readNumber(const vector<string> &tokens, size_t &index, float &value)
+{
+  if (index >= tokens.size())
+    return false;
+  char *end;
+  value = strtof(tokens[index].c_str(), &end);
+  if (*end != '\0' || end == tokens[index].c_str())
+    return false;
+  index++;
+  return true;
+}
+
+static bool readVec3(const vector<string> &tokens, size_t &index, Vec3 &value)
+{
+  float x, y, z;
+  if (!readNumber(tokens, index, x) || !readNumber(tokens, index, y) || !readNumber(tokens, index, z))
+    return false;
+  value = Vec3(x, y, z);
+  return true;
+}
+
+SceneFile::SceneFile():
+  gravity(0.0f, -9.81f, 0.0f), camera_scale(1.0f), camera_offset(Vec3::sZero()), camera_follow(-1),
+  camera_swap_xz(false), physics(new PhysicsScene)
+{
+}
+
+bool SceneFile::read(const string &file_name, string &source)
+{
+  ifstream file(file_name);
+  if (!file) {
+    cerr << "Could not open scene file " << file_name << endl;
+    return false;
+  };
+  stringstream buffer;
+  buffer << file.rdbuf();
+  source = buffer.str();
+  return true;
+}
+
+bool SceneFile::load(const string &file_name)
+{
+  string source;
+  return read(file_name, source) && parse(source, file_name);
+}
+
+bool SceneFile::parse(const string &source, const string &file_name)
+{
+  text = source;
+  istringstream lines(source);
+  string line;
+  int number = 0;
+  while (getline(lines, line)) {
+    number++;
+    size_t comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    istringstream words(line);
+    vector<string> tokens;
+    string word;
+    while (words >> word)
+      tokens.push_back(word);
+    if (tokens.empty())
+      continue;
+    if (!parseLine(tokens)) {
+      cerr << file_name << ":" << number << ": " << error << endl;
+      return false;
+    };
+  };
+  if (!finishVehicles()) {
+    cerr << file_name << ": " << error << endl;
+    return false;
+  };
+  return true;
+}
+
+bool SceneFile::parseLine(vector<string> &tokens)
+{
+  const string &command = tokens[0];
+  if (command == "gravity") {
+    size_t index = 1;
+    if (!readVec3(tokens, index, gravity)) {
+      error = "gravity expects three numbers";
+      return false;
+    };
+    return true;
+  } else if (command == "camera") {
+    for (size_t index=1; index<tokens.size(); ) {
+      const string &key = tokens[index++];
+      bool ok = true;
+      if (key == "scale")
+        ok = readNumber(tokens, index, camera_scale);
+      else if (key == "offset")
+        ok = readVec3(tokens, index, camera_offset);
+      else if (key == "follow") {
+        uint32 body = 0;
+        ok = index < tokens.size() && findBody(tokens[index++], body, false);
+        camera_follow = body;
+      } else if (key == "swap_xz")
+        camera_swap_xz = true;
+      else {
+        error = "unknown camera option " + key;
+        return false;
+      };
+      if (!ok) {
+        if (error.empty())
+          error = "invalid value for camera option " + key;
+        return false;
+      };
+    };
+    return true;
+  } else if (command == "shape") {
+    if (tokens.size() < 3) {
+      error = "shape expects a name and a shape";
+      return false;
+    };
+    size_t index = 2;
+    RefConst<Shape> shape;
+    if (!parseShape(tokens, index, shape))
+      return false;
+    if (index != tokens.size()) {
+      error = "unexpected " + tokens[index];
+      return false;
+    };
+    shapes[tokens[1]] = shape;
+    return true;
+  } else if (command == "body")
+    return parseBody(tokens);
+  else if (command == "constraint")
+    return parseConstraint(tokens);
+  else if (command == "vehicle")
+    return parseVehicle(tokens);
+  else if (command == "wheel")
+    return parseWheel(tokens);
+  error = "unknown command " + command;
+  return false;
+}
+
+bool SceneFile::parseShape(vector<string> &tokens, size_t &index, RefConst<Shape> &shape)
+{
+  if (index >= tokens.size()) {
+    error = "missing shape";
+    return false;
+  };
+  const string type = tokens[index];
+  auto named = shapes.find(type);
+  if (named != shapes.end()) {
+    shape = named->second;
+    index++;
+    return true;
+  };
+  index++;
+  vector<float> parameters;
+  float value;
+  while (readNumber(tokens, index, value))
+    parameters.push_back(value);
+  float convex_radius = cDefaultConvexRadius;
+  float density = 1000.0f;
+  while (index < tokens.size()) {
+    if (tokens[index] == "convex_radius") {
+      index++;
+      if (!readNumber(tokens, index, convex_radius)) {
+        error = "convex_radius expects a number";
+        return false;
+      };
+    } else if (tokens[index] == "density") {
+      index++;
+      if (!readNumber(tokens, index, density)) {
+        error = "density expects a number";
+        return false;
+      };
+    } else
+      break;
+  };
+
+  // Identical parameters result in the same shape
+  ostringstream key;
+  key.precision(9);
+  key << type;
+  for (float parameter: parameters)
+    key << " " << parameter;
+  key << " " << convex_radius << " " << density;
+  auto existing = unique_shapes.find(key.str());
+  if (existing != unique_shapes.end()) {
+    shape = existing->second;
+    return true;
+  };
+
+  ShapeSettings::ShapeResult result;
+  if (type == "box" && parameters.size() == 3) {
+    BoxShapeSettings settings(Vec3(parameters[0], parameters[1], parameters[2]), convex_radius);
+    settings.SetDensity(density);
+    settings.SetEmbedded();
+    result = settings.Create();
+  } else if (type == "sphere" && parameters.size() == 1) {
+    SphereShapeSettings settings(parameters[0]);
+    settings.SetDensity(density);
+    settings.SetEmbedded();
+    result = settings.Create();
+  } else if (type == "capsule" && parameters.size() == 2) {
+    CapsuleShapeSettings settings(parameters[0], parameters[1]);
+    settings.SetDensity(density);
+    settings.SetEmbedded();
+    result = settings.Create();
+  } else if (type == "cylinder" && parameters.size() == 2) {
+    CylinderShapeSettings settings(parameters[0], parameters[1], convex_radius);
+    settings.SetDensity(density);
+    settings.SetEmbedded();
+    result = settings.Create();
+  } else if (type == "hull" && parameters.size() >= 12 && parameters.size() % 3 == 0) {
+    Array<Vec3> points;
+    for (size_t i=0; i<parameters.size(); i+=3)
+      points.push_back(Vec3(parameters[i], parameters[i + 1], parameters[i + 2]));
+    ConvexHullShapeSettings settings(points, convex_radius);
+    settings.SetDensity(density);
+    settings.SetEmbedded();
+    result = settings.Create();
+  } else if (type == "heightfield" && parameters.size() == 3 && parameters[0] >= 4 && (int)parameters[0] % 2 == 0) {
+    // Rolling hills centered around the origin
+    uint32 count = (uint32)parameters[0];
+    float size = parameters[1];
+    Array<float> samples(count * count);
+    for (uint32 z=0; z<count; z++)
+      for (uint32 x=0; x<count; x++) {
+        float u = 2.0f * JPH_PI * x / (count - 1);
+        float v = 2.0f * JPH_PI * z / (count - 1);
+        samples[z * count + x] = 0.5f + 0.25f * (sinf(3.0f * u) + sinf(2.0f * v));
+      };
+    Vec3 scale(size / (count - 1), parameters[2], size / (count - 1));
+    HeightFieldShapeSettings settings(samples.data(), Vec3(-0.5f * size, 0.0f, -0.5f * size), scale, count);
+    settings.SetEmbedded();
+    result = settings.Create();
+  } else {
+    error = "unknown shape or wrong number of parameters for " + type;
+    return false;
+  };
+  if (result.HasError()) {
+    error = string("could not create shape: ") + result.GetError().c_str();
+    return false;
+  };
+  shape = result.Get();
+  unique_shapes[key.str()] = shape;
+  return true;
+}
+
+bool SceneFile::parseBody(vector<string> &tokens)
+{
+  if (tokens.size() < 3) {
+    error = "body expects a name and a shape";
+    return false;
+  };
+  if (bodies.find(tokens[1]) != bodies.end()) {
+    error = "duplicate body " + tokens[1];
+    return false;
+  };
+  size_t index = 2;
+  RefConst<Shape> shape;
+  if (!parseShape(tokens, index, shape))
+    return false;
+  BodyCreationSettings settings(shape, RVec3::sZero(), Quat::sIdentity(), EMotionType::Dynamic, SceneLayers::MOVING);
+  bool ghost = false;
+  Vec3 grid(1.0f, 1.0f, 1.0f);
+  Vec3 spacing = Vec3::sZero();
+  while (index < tokens.size()) {
+    const string &key = tokens[index++];
+    bool ok = true;
+    Vec3 value3 = Vec3::sZero();
+    float value = 0.0f;
+    if (key == "static")
+      settings.mMotionType = EMotionType::Static;
+    else if (key == "kinematic")
+      settings.mMotionType = EMotionType::Kinematic;
+    else if (key == "dynamic")
+      settings.mMotionType = EMotionType::Dynamic;
+    else if (key == "position") {
+      ok = readVec3(tokens, index, value3);
+      settings.mPosition = RVec3(value3);
+    } else if (key == "rotation") {
+      ok = readVec3(tokens, index, value3) && readNumber(tokens, index, value) && value3.LengthSq() > 0.0f;
+      if (ok)
+        settings.mRotation = Quat::sRotation(value3.Normalized(), DegreesToRadians(value));
+    } else if (key == "linear_velocity")
+      ok = readVec3(tokens, index, settings.mLinearVelocity);
+    else if (key == "angular_velocity")
+      ok = readVec3(tokens, index, settings.mAngularVelocity);
+    else if (key == "friction")
+      ok = readNumber(tokens, index, settings.mFriction);
+    else if (key == "restitution")
+      ok = readNumber(tokens, index, settings.mRestitution);
+    else if (key == "mass") {
+      ok = readNumber(tokens, index, settings.mMassPropertiesOverride.mMass);
+      settings.mOverrideMassProperties = EOverrideMassProperties::CalculateInertia;
+    } else if (key == "damping")
+      ok = readNumber(tokens, index, settings.mLinearDamping) && readNumber(tokens, index, settings.mAngularDamping);
+    else if (key == "max_linear_velocity")
+      ok = readNumber(tokens, index, settings.mMaxLinearVelocity);
+    else if (key == "linear_cast")
+      settings.mMotionQuality = EMotionQuality::LinearCast;
+    else if (key == "gyroscopic")
+      settings.mApplyGyroscopicForce = true;
+    else if (key == "ghost")
+      ghost = true;
+    else if (key == "grid") {
+      ok = readVec3(tokens, index, grid) && readVec3(tokens, index, spacing);
+      for (int i=0; i<3 && ok; i++)
+        ok = grid[i] >= 1.0f && floor(grid[i]) == grid[i];
+    } else {
+      error = "unknown body option " + key;
+      return false;
+    };
+    if (!ok) {
+      error = "invalid value for body option " + key;
+      return false;
+    };
+  };
+  if (ghost)
+    settings.mObjectLayer = SceneLayers::GHOST;
+  else if (settings.mMotionType == EMotionType::Static)
+    settings.mObjectLayer = SceneLayers::STATIC;
+  if (grid == Vec3::sOne()) {
+    bodies[tokens[1]] = physics->GetNumBodies();
+    names.push_back(tokens[1]);
+    physics->AddBody(settings);
+    return true;
+  };
+  // Copies on a grid are named <name>.<index> with the index running along x first
+  RVec3 origin = settings.mPosition;
+  int copy = 0;
+  for (int z=0; z<(int)grid.GetZ(); z++)
+    for (int y=0; y<(int)grid.GetY(); y++)
+      for (int x=0; x<(int)grid.GetX(); x++) {
+        string name = tokens[1] + "." + to_string(copy++);
+        if (bodies.find(name) != bodies.end()) {
+          error = "duplicate body " + name;
+          return false;
+        };
+        settings.mPosition = origin + RVec3(spacing * Vec3((float)x, (float)y, (float)z));
+        bodies[name] = physics->GetNumBodies();
+        names.push_back(name);
+        physics->AddBody(settings);
+      };
+  return true;
+}
+
+bool SceneFile::findBody(const string &name, uint32 &index, bool allow_world)
+{
+  if (allow_world && name == "world") {
+    index = PhysicsScene::cFixedToWorld;
+    return true;
+  };
+  auto body = bodies.find(name);
+  if (body == bodies.end()) {
+    error = "unknown body " + name;
+    return false;
+  };
+  index = body->second;
+  return true;
+}
+
+bool SceneFile::parseConstraint(vector<string> &tokens)
+{
+  if (tokens.size() < 4) {
+    error = "constraint expects a type and two bodies";
+    return false;
+  };
+  const string &type = tokens[1];
+  uint32 body1, body2;
+  if (!findBody(tokens[2], body1, true) || !findBody(tokens[3], body2, false))
+    return false;
+
+  // Collect the values of all options first and check the ones required for the constraint type afterwards
+  map<string, vector<float>> values;
+  size_t index = 4;
+  while (index < tokens.size()) {
+    const string &key = tokens[index++];
+    vector<float> &numbers = values[key];
+    float value;
+    while (readNumber(tokens, index, value))
+      numbers.push_back(value);
+  };
+  auto get = [&](const char *key, size_t count, float *result) {
+    auto found = values.find(key);
+    if (found == values.end())
+      return false;
+    if (found->second.size() != count) {
+      error = string(key) + " expects " + to_string(count) + " number(s)";
+      return false;
+    };
+    copy(found->second.begin(), found->second.end(), result);
+    values.erase(found);
+    return true;
+  };
+  auto require = [&](const char *key, size_t count, float *result) {
+    if (get(key, count, result))
+      return true;
+    if (error.empty())
+      error = type + " constraint requires " + key;
+    return false;
+  };
+  float point[3], axis[3], normal[3], limits[2], point2[3];
+
+  Ref<TwoBodyConstraintSettings> constraint;
+  if (type == "hinge") {
+    HingeConstraintSettings *hinge = new HingeConstraintSettings;
+    constraint = hinge;
+    if (!require("point", 3, point) || !require("axis", 3, axis) || !require("normal", 3, normal))
+      return false;
+    hinge->mPoint1 = hinge->mPoint2 = RVec3(point[0], point[1], point[2]);
+    hinge->mHingeAxis1 = hinge->mHingeAxis2 = Vec3(axis[0], axis[1], axis[2]).Normalized();
+    hinge->mNormalAxis1 = hinge->mNormalAxis2 = Vec3(normal[0], normal[1], normal[2]).Normalized();
+    if (get("limits", 2, limits)) {
+      hinge->mLimitsMin = DegreesToRadians(limits[0]);
+      hinge->mLimitsMax = DegreesToRadians(limits[1]);
+    };
+  } else if (type == "point") {
+    PointConstraintSettings *joint = new PointConstraintSettings;
+    constraint = joint;
+    if (!require("point", 3, point))
+      return false;
+    joint->mPoint1 = joint->mPoint2 = RVec3(point[0], point[1], point[2]);
+  } else if (type == "fixed") {
+    FixedConstraintSettings *fixed = new FixedConstraintSettings;
+    constraint = fixed;
+    fixed->mAutoDetectPoint = true;
+  } else if (type == "slider") {
+    SliderConstraintSettings *slider = new SliderConstraintSettings;
+    constraint = slider;
+    if (!require("axis", 3, axis))
+      return false;
+    slider->mAutoDetectPoint = true;
+    slider->SetSliderAxis(Vec3(axis[0], axis[1], axis[2]).Normalized());
+    if (get("limits", 2, limits)) {
+      slider->mLimitsMin = limits[0];
+      slider->mLimitsMax = limits[1];
+    };
+  } else if (type == "distance") {
+    DistanceConstraintSettings *distance = new DistanceConstraintSettings;
+    constraint = distance;
+    if (!require("point1", 3, point) || !require("point2", 3, point2))
+      return false;
+    distance->mPoint1 = RVec3(point[0], point[1], point[2]);
+    distance->mPoint2 = RVec3(point2[0], point2[1], point2[2]);
+    get("min", 1, &distance->mMinDistance);
+    get("max", 1, &distance->mMaxDistance);
+    get("stiffness", 1, &distance->mLimitsSpringSettings.mStiffness);
+    get("damping", 1, &distance->mLimitsSpringSettings.mDamping);
+  } else if (type == "swing_twist") {
+    SwingTwistConstraintSettings *swing_twist = new SwingTwistConstraintSettings;
+    constraint = swing_twist;
+    if (!require("point", 3, point) || !require("twist_axis", 3, axis) || !require("plane_axis", 3, normal))
+      return false;
+    swing_twist->mPosition1 = swing_twist->mPosition2 = RVec3(point[0], point[1], point[2]);
+    swing_twist->mTwistAxis1 = swing_twist->mTwistAxis2 = Vec3(axis[0], axis[1], axis[2]).Normalized();
+    swing_twist->mPlaneAxis1 = swing_twist->mPlaneAxis2 = Vec3(normal[0], normal[1], normal[2]).Normalized();
+    float cone = 0.0f;
+    if (get("cone", 1, &cone))
+      swing_twist->mNormalHalfConeAngle = swing_twist->mPlaneHalfConeAngle = DegreesToRadians(cone);
+    if (get("twist", 2, limits)) {
+      swing_twist->mTwistMinAngle = DegreesToRadians(limits[0]);
+      swing_twist->mTwistMaxAngle = DegreesToRadians(limits[1]);
+    };
+  } else {
+    error = "unknown constraint type " + type;
+    return false;
+  };
+  if (!error.empty())
+    return false;
+  if (!values.empty()) {
+    error = "unexpected option " + values.begin()->first + " for " + type + " constraint";
+    return false;
+  };
+  physics->AddConstraint(constraint, body1, body2);
+  return true;
+}
+
+bool SceneFile::parseVehicle(vector<string> &tokens)
+{
+  Vehicle vehicle;
+  if (tokens.size() < 2) {
+    error = "vehicle expects a body";
+    return false;
+  };
+  // A body created on a grid gets a vehicle for each copy, all sharing the settings and wheels
+  vector<uint32> targets;
+  for (int copy=0; bodies.find(tokens[1] + "." + to_string(copy)) != bodies.end(); copy++)
+    targets.push_back(bodies[tokens[1] + "." + to_string(copy)]);
+  if (targets.empty()) {
+    if (!findBody(tokens[1], vehicle.body, false))
+      return false;
+    targets.push_back(vehicle.body);
+  };
+  vehicle.settings = new VehicleConstraintSettings;
+  WheeledVehicleControllerSettings *controller = new WheeledVehicleControllerSettings;
+  vehicle.settings->mController = controller;
+  fill(vehicle.input, vehicle.input + 4, 0.0f);
+  size_t index = 2;
+  while (index < tokens.size()) {
+    const string &key = tokens[index++];
+    bool ok;
+    if (key == "input")
+      ok = readNumber(tokens, index, vehicle.input[0]) && readNumber(tokens, index, vehicle.input[1]) &&
+           readNumber(tokens, index, vehicle.input[2]) && readNumber(tokens, index, vehicle.input[3]);
+    else if (key == "max_pitch_roll") {
+      float angle = 0.0f;
+      ok = readNumber(tokens, index, angle);
+      vehicle.settings->mMaxPitchRollAngle = DegreesToRadians(angle);
+    } else if (key == "differential") {
+      float left = 0.0f;
+      float right = 0.0f;
+      ok = readNumber(tokens, index, left) && readNumber(tokens, index, right) && left >= 0.0f && right >= 0.0f;
+      VehicleDifferentialSettings differential;
+      differential.mLeftWheel = (int)left;
+      differential.mRightWheel = (int)right;
+      controller->mDifferentials.push_back(differential);
+    } else if (key == "torque") {
+      ok = readNumber(tokens, index, controller->mEngine.mMaxTorque);
+      explicit_torque.insert(vehicle.settings);
+    } else {
+      error = "unknown vehicle option " + key;
+      return false;
+    };
+    if (!ok) {
+      error = "invalid value for vehicle option " + key;
+      return false;
+    };
+  };
+  for (uint32 body: targets) {
+    vehicle.body = body;
+    vehicles.push_back(vehicle);
+  };
+  return true;
+}
+
+// The wheels follow the vehicle line, so the drive train is completed once the whole file is parsed. Without a
+// differential the last two wheels (the rear axle in the examples) are driven like in vehicle.cc. The default engine
+// torque of Jolt (500 Nm) only suits full size cars, without "torque" it is a tenth of the weight of the body times the
+// radius of the driven wheels.
+bool SceneFile::finishVehicles()
+{
+  for (Vehicle &vehicle: vehicles) {
+    VehicleConstraintSettings &settings = *vehicle.settings;
+    WheeledVehicleControllerSettings &controller = static_cast<WheeledVehicleControllerSettings &>(*settings.mController);
+    int num_wheels = (int)settings.mWheels.size();
+    if (num_wheels == 0)
+      continue;
+    if (controller.mDifferentials.empty()) {
+      controller.mDifferentials.resize(1);
+      controller.mDifferentials[0].mLeftWheel = max(num_wheels - 2, 0);
+      controller.mDifferentials[0].mRightWheel = num_wheels > 1 ? num_wheels - 1 : -1;
+    };
+    for (VehicleDifferentialSettings &differential: controller.mDifferentials) {
+      if (differential.mLeftWheel >= num_wheels || differential.mRightWheel >= num_wheels) {
+        error = "differential of vehicle " + names[vehicle.body] + " refers to a missing wheel";
+        return false;
+      };
+      differential.mEngineTorqueRatio = 1.0f / controller.mDifferentials.size();
+    };
+    if (explicit_torque.count(&settings) == 0) {
+      float mass = physics->GetBodies()[vehicle.body].GetMassProperties().mMass;
+      float radius = settings.mWheels[controller.mDifferentials[0].mLeftWheel]->mRadius;
+      controller.mEngine.mMaxTorque = 0.1f * mass * gravity.Length() * radius;
+    };
+  };
+  return true;
+}
+
+bool SceneFile::parseWheel(vector<string> &tokens)
+{
+  if (vehicles.empty()) {
+    error = "wheel without vehicle";
+    return false;
+  };
+  WheelSettingsWV *wheel = new WheelSettingsWV;
+  vehicles.back().settings->mWheels.push_back(wheel);
+  wheel->mAngularDamping = 0.0f;
+  wheel->mMaxSteerAngle = 0.0f;
+  bool position = false;
+  size_t index = 1;
+  while (index < tokens.size()) {
+    const string &key = tokens[index++];
+    bool ok;
+    float value = 0.0f;
+    if (key == "position")
+      ok = position = readVec3(tokens, index, wheel->mPosition);
+    else if (key == "radius")
+      ok = readNumber(tokens, index, wheel->mRadius);
+    else if (key == "width")
+      ok = readNumber(tokens, index, wheel->mWidth);
+    else if (key == "suspension")
+      ok = readNumber(tokens, index, wheel->mSuspensionMinLength) && readNumber(tokens, index, wheel->mSuspensionMaxLength);
+    else if (key == "steer") {
+      ok = readNumber(tokens, index, value);
+      wheel->mMaxSteerAngle = DegreesToRadians(value);
+    } else if (key == "hand_brake")
+      ok = readNumber(tokens, index, wheel->mMaxHandBrakeTorque);
+    else if (key == "inertia")
+      ok = readNumber(tokens, index, wheel->mInertia);
+    else if (key == "angular_damping")
+      ok = readNumber(tokens, index, wheel->mAngularDamping);
+    else {
+      error = "unknown wheel option " + key;
+      return false;
+    };
+    if (!ok) {
+      error = "invalid value for wheel option " + key;
+      return false;
+    };
+  };
+  if (!position) {
+    error = "wheel requires position";
+    return false;
+  };
+  return true;
+}
+
+bool createScene(const SceneFile &scene, PhysicsSystem &physics_system, SceneInstance &instance)
+{
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  physics_system.SetGravity(scene.gravity);
+  const PhysicsScene &physics = *scene.physics;
+  for (const BodyCreationSettings &settings: physics.GetBodies()) {
+    Body *body = body_interface.CreateBody(settings);
+    if (body == nullptr) {
+      cerr << "Could not create body, increase the maximum number of bodies" << endl;
+      destroyScene(physics_system, instance);
+      return false;
+    };
+    instance.bodies.push_back(body);
+  };
+  // Add all bodies in one batch which is faster than adding them one by one
+  BodyIDVector ids;
+  for (Body *body: instance.bodies)
+    ids.push_back(body->GetID());
+  if (!ids.empty()) {
+    BodyInterface::AddState state = body_interface.AddBodiesPrepare(ids.data(), ids.size());
+    body_interface.AddBodiesFinalize(ids.data(), ids.size(), state, EActivation::Activate);
+  };
+
+  for (const PhysicsScene::ConnectedConstraint &connected: physics.GetConstraints()) {
+    Body &body1 = connected.mBody1 == PhysicsScene::cFixedToWorld? Body::sFixedToWorld : *instance.bodies[connected.mBody1];
+    Body &body2 = connected.mBody2 == PhysicsScene::cFixedToWorld? Body::sFixedToWorld : *instance.bodies[connected.mBody2];
+    Ref<Constraint> constraint = connected.mSettings->Create(body1, body2);
+    physics_system.AddConstraint(constraint);
+    instance.constraints.push_back(constraint);
+  };
+
+  for (const SceneFile::Vehicle &vehicle: scene.vehicles) {
+    Ref<VehicleConstraint> constraint = new VehicleConstraint(*instance.bodies[vehicle.body], *vehicle.settings);
+    constraint->SetVehicleCollisionTester(new VehicleCollisionTesterRay(SceneLayers::MOVING));
+    physics_system.AddConstraint(constraint);
+    physics_system.AddStepListener(constraint);
+    WheeledVehicleController *controller = static_cast<WheeledVehicleController *>(constraint->GetController());
+    controller->SetDriverInput(vehicle.input[0], vehicle.input[1], vehicle.input[2], vehicle.input[3]);
+    instance.vehicles.push_back(constraint);
+  };
+  return true;
+}
+
+void destroyScene(PhysicsSystem &physics_system, SceneInstance &instance)
+{
+  for (auto vehicle=instance.vehicles.begin(); vehicle!=instance.vehicles.end(); vehicle++) {
+    physics_system.RemoveStepListener(*vehicle);
+    physics_system.RemoveConstraint(*vehicle);
+  };
+  for (auto constraint=instance.constraints.begin(); constraint!=instance.constraints.end(); constraint++)
+    physics_system.RemoveConstraint(*constraint);
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  for (Body *body: instance.bodies) {
+    if (body_interface.IsAdded(body->GetID()))
+      body_interface.RemoveBody(body->GetID());
+    body_interface.DestroyBody(body->GetID());
+  };
+  instance.vehicles.clear();
+  instance.constraints.clear();
+  instance.bodies.clear();
+}
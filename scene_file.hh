@@ -0,0 +1,106 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsScene.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Vehicle/VehicleConstraint.h>
+
+namespace SceneLayers
+{
+  static constexpr JPH::ObjectLayer STATIC = 0;
+  static constexpr JPH::ObjectLayer MOVING = 1;
+  static constexpr JPH::ObjectLayer GHOST = 2;
+  static constexpr JPH::uint NUM_LAYERS = 3;
+};
+
+// Declarative scene description.
+//
+// The file is parsed line by line, "#" starts a comment. Lengths are in meters and angles in degrees.
+//
+//   gravity <x> <y> <z>
+//   camera [scale <s>] [offset <x> <y> <z>] [follow <body>] [swap_xz]
+//   shape <name> <shape>
+//   body <name> <shape name or shape> [static|kinematic|dynamic] [position <x> <y> <z>] [rotation <axis x y z> <angle>]
+//        [linear_velocity <x> <y> <z>] [angular_velocity <x> <y> <z>] [friction <f>] [restitution <r>] [mass <m>]
+//        [damping <linear> <angular>] [max_linear_velocity <v>] [linear_cast] [gyroscopic] [ghost]
+//        [grid <nx> <ny> <nz> <spacing x y z>]
+//   constraint hinge <body1|world> <body2> point <x> <y> <z> axis <x> <y> <z> normal <x> <y> <z> [limits <min> <max>]
+//   constraint point <body1|world> <body2> point <x> <y> <z>
+//   constraint fixed <body1|world> <body2>
+//   constraint slider <body1|world> <body2> axis <x> <y> <z> [limits <min> <max>]
+//   constraint distance <body1|world> <body2> point1 <x> <y> <z> point2 <x> <y> <z> [min <d>] [max <d>]
+//              [stiffness <frequency>] [damping <ratio>]
+//   constraint swing_twist <body1|world> <body2> point <x> <y> <z> twist_axis <x> <y> <z> plane_axis <x> <y> <z>
+//              [cone <half angle>] [twist <min> <max>]
+//   vehicle <body> [input <forward> <right> <brake> <hand brake>] [max_pitch_roll <angle>]
+//           [differential <left wheel> <right wheel>] [torque <engine torque>]
+//   wheel position <x> <y> <z> radius <r> width <w> [suspension <min> <max>] [steer <angle>] [hand_brake <torque>]
+//         [inertia <i>] [angular_damping <d>]
+//
+// where a shape is one of
+//
+//   box <half x> <half y> <half z> [convex_radius <r>] [density <d>]
+//   sphere <radius> [density <d>]
+//   capsule <half height> <radius> [density <d>]
+//   cylinder <half height> <radius> [convex_radius <r>] [density <d>]
+//   hull <x> <y> <z> <x> <y> <z> ... [convex_radius <r>] [density <d>]
+//   heightfield <samples per side> <size> <height>
+//
+// A body with a grid is created nx * ny * nz times, offset by multiples of the spacing from its position, and the
+// copies are named <name>.0, <name>.1, ... A vehicle of a body with a grid is added to every copy. Wheels belong to the
+// most recent vehicle and are numbered from 0 in their order. Each differential drives a pair of wheels, vehicles
+// without one drive their last two wheels. The engine torque in Nm defaults to a tenth of the weight of the body times
+// the radius of the driven wheels. Shapes with identical parameters are only created once. Height fields generate
+// rolling hills centered around the origin and can only be used for static bodies.
+class SceneFile
+{
+  public:
+    struct Vehicle
+    {
+      JPH::uint body;
+      JPH::Ref<JPH::VehicleConstraintSettings> settings;
+      float input[4];
+    };
+    SceneFile();
+    static bool read(const std::string &file_name, std::string &source);
+    bool load(const std::string &file_name);
+    bool parse(const std::string &source, const std::string &file_name);
+    JPH::Vec3 gravity;
+    float camera_scale;
+    JPH::Vec3 camera_offset;
+    int camera_follow;
+    bool camera_swap_xz;
+    JPH::Ref<JPH::PhysicsScene> physics;
+    std::vector<std::string> names;
+    std::vector<Vehicle> vehicles;
+    std::string text;
+  private:
+    bool parseLine(std::vector<std::string> &tokens);
+    bool parseShape(std::vector<std::string> &tokens, size_t &index, JPH::RefConst<JPH::Shape> &shape);
+    bool parseBody(std::vector<std::string> &tokens);
+    bool parseConstraint(std::vector<std::string> &tokens);
+    bool parseVehicle(std::vector<std::string> &tokens);
+    bool parseWheel(std::vector<std::string> &tokens);
+    bool finishVehicles();
+    bool findBody(const std::string &name, JPH::uint32 &index, bool allow_world);
+    std::string error;
+    std::map<std::string, JPH::RefConst<JPH::Shape>> shapes;
+    std::map<std::string, JPH::RefConst<JPH::Shape>> unique_shapes;
+    std::map<std::string, JPH::uint32> bodies;
+    std::set<const JPH::VehicleConstraintSettings *> explicit_torque;
+};
+
+// Bodies and constraints of a scene added to a physics system
+struct SceneInstance
+{
+  std::vector<JPH::Body *> bodies;
+  std::vector<JPH::Ref<JPH::Constraint>> constraints;
+  std::vector<JPH::Ref<JPH::VehicleConstraint>> vehicles;
+};
+
+bool createScene(const SceneFile &scene, JPH::PhysicsSystem &physics_system, SceneInstance &instance);
+
+void destroyScene(JPH::PhysicsSystem &physics_system, SceneInstance &instance);
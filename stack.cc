@@ -1,5 +1,10 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
 #include <cstdarg>
+#include <cstdio>
+#include <random>
 #include <thread>
 #include <Jolt/Jolt.h>
 #include <Jolt/Core/Factory.h>
@@ -14,6 +19,16 @@
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "options.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "physics_settings.hh"
+#include "allocator.hh"
+#include "frame_pacer.hh"
+#include "step_stats.hh"
+#include "contact_events.hh"
+#include "body_pool.hh"
+#include "broadphase_policy.hh"
 
 
 using namespace std;
@@ -153,12 +168,23 @@ GLfloat vertices[] = {
 };
 
 unsigned int indices[] = {
-   0,  1,  2,  3,
-   4,  5,  6,  7,
-   8,  9, 10, 11,
-  12, 13, 14, 15,
-  16, 17, 18, 19,
-  20, 21, 22, 23
+   0,  1,  2,  0,  2,  3,
+   4,  5,  6,  4,  6,  7,
+   8,  9, 10,  8, 10, 11,
+  12, 13, 14, 12, 14, 15,
+  16, 17, 18, 16, 18, 19,
+  20, 21, 22, 20, 22, 23
+};
+
+// Edge length of the spawned cubes, they are removed below the fall limit or after sleeping for "--despawn-sleep" seconds
+const float cDebrisSize = 0.1f;
+const double cSpawnHeight = 1.0;
+const double cFallLimit = -2.0;
+
+struct Debris
+{
+  Body *body;
+  double sleep;
 };
 
 void handleCompileError(const char *step, GLuint shader)
@@ -185,12 +211,38 @@ void handleLinkError(const char *step, GLuint program)
   };
 }
 
-int main(void)
+void drawBox(GLuint program, RMat44Arg transform)
+{
+  RVec3 position = transform.GetTranslation();
+  Vec3 x = transform.GetAxisX();
+  Vec3 y = transform.GetAxisY();
+  Vec3 z = transform.GetAxisZ();
+  float translation[3] = {(float)position.GetX(), (float)position.GetY(), (float)position.GetZ()};
+  glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
+  float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
+  glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
+  glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
+}
+
+int main(int argc, char *argv[])
 {
+  Options options(argc, argv);
+  width = options.getInt("width", width);
+  height = options.getInt("height", height);
+  Capture capture(options, width, height);
+
   glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  capture.hints();
   GLFWwindow *window = glfwCreateWindow(width, height, "Falling stack of boxes with Jolt Physics", NULL, NULL);
   glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
   glewInit();
+  capture.init();
+  FramePacer pacer(options);
 
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
@@ -208,6 +260,8 @@ int main(void)
   GLuint program = glCreateProgram();
   glAttachShader(program, vertexShader);
   glAttachShader(program, fragmentShader);
+  glBindAttribLocation(program, 0, "point");
+  glBindAttribLocation(program, 1, "normal");
   glLinkProgram(program);
   handleLinkError("Shader program", program);
 
@@ -249,7 +303,7 @@ int main(void)
   float axes[3] = {a, b, c};
   glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
 
-  RegisterDefaultAllocator();
+  registerAllocator(options);
   Trace = TraceImpl;
   JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
   Factory::sInstance = new Factory();
@@ -258,17 +312,23 @@ int main(void)
   TempAllocatorMalloc temp_allocator;
   JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
 
-  const uint cMaxBodies = 1024;
+  // "--spawn RATE" drops cubes at RATE bodies per second, they are taken from a pool of "--pool N" bodies
+  double spawn_rate = options.getDouble("spawn", 0.0);
+  uint pool_size = spawn_rate > 0.0 ? options.getInt("pool", 512) : 0;
+  double despawn_sleep = options.getDouble("despawn-sleep", 2.0);
+
+  const uint cMaxBodies = 1024 + pool_size;
   const uint cNumBodyMutexes = 0;
-  const uint cMaxBodyPairs = 1024;
-  const uint cMaxContactConstraints = 1024;
+  const uint cMaxBodyPairs = 1024 + 8 * pool_size;
+  const uint cMaxContactConstraints = 1024 + 8 * pool_size;
   BPLayerInterfaceImpl broad_phase_layer_interface;
   ObjectLayerPairFilterImpl object_vs_object_layer_filter;
   ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
 
   PhysicsSystem physics_system;
-  physics_system.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
-                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  initPhysicsSystem(physics_system, cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                    broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
   physics_system.SetGravity(Vec3(0, -0.4, 0));
   BodyInterface &body_interface = physics_system.GetBodyInterface();
 
@@ -306,41 +366,174 @@ int main(void)
 
   physics_system.OptimizeBroadPhase();
 
+  // "--no-pool" creates and destroys the cubes instead to compare the cost of the churn
+  unique_ptr<BodyPool> debris_pool;
+  if (spawn_rate > 0.0) {
+    BoxShapeSettings debris_shape_settings(Vec3::sReplicate(0.5 * cDebrisSize));
+    debris_shape_settings.mConvexRadius = 0.01;
+    debris_shape_settings.SetDensity(1000.0);
+    debris_shape_settings.SetEmbedded();
+    ShapeSettings::ShapeResult debris_shape_result = debris_shape_settings.Create();
+    ShapeRefC debris_shape = debris_shape_result.Get();
+    BodyCreationSettings debris_settings(debris_shape, RVec3::sZero(), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
+    debris_settings.mFriction = 0.5f;
+    debris_settings.mRestitution = 0.3f;
+    debris_pool.reset(new BodyPool(body_interface, debris_settings, pool_size, !options.has("no-pool")));
+  };
+  BroadPhasePolicy broadphase(options);
+  vector<Debris> debris;
+  double spawn_credit = 0.0;
+  uint spawned = 0;
+  uint despawned = 0;
+  vector<double> churn_times;
+  vector<double> step_times;
+  mt19937 random(1);
+  uniform_real_distribution<double> spawn_position(-0.8, 0.8);
+
+  unique_ptr<Telemetry> telemetry;
+  if (options.has("telemetry"))
+    telemetry.reset(new Telemetry(options.getString("telemetry", ""), stateColumns()));
+  unique_ptr<StepStatistics> step_stats;
+  if (options.has("step-stats")) {
+    step_stats.reset(new StepStatistics(options.getString("step-stats", ""), cMaxContactConstraints));
+    step_stats->attach(physics_system);
+  };
+  // "--impacts" prints the contacts which start with an approach speed above "--impact-speed" (e.g. to play sounds)
+  unique_ptr<ContactEvents> contact_events;
+  double impact_speed = options.getDouble("impact-speed", 0.05);
+  if (options.has("impacts")) {
+    contact_events.reset(new ContactEvents(4096, step_stats.get()));
+    physics_system.SetContactListener(contact_events.get());
+  };
+  uint64 step = 0;
+  double sim_time = 0.0;
+
+  // Key M prints the memory report
+  bool memory_down = false;
+  pacer.init();
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
-    double dt = glfwGetTime() - t;
+    double dt = capture.enabled() ? capture.timestep() : glfwGetTime() - t;
+    capture.beginFrame();
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
     for (int i=0; i<3; i++) {
       Body *body = boxes[i];
       body_interface.ActivateBody(body->GetID());
-      RMat44 transform = body_interface.GetWorldTransform(body->GetID());
-      RVec3 position = transform.GetTranslation();
-      Vec3 x = transform.GetAxisX();
-      Vec3 y = transform.GetAxisY();
-      Vec3 z = transform.GetAxisZ();
-      float translation[3] = {(float)position.GetX(), (float)position.GetY(), (float)position.GetZ()};
-      glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-      float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
-      glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-      glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
+      drawBox(program, body_interface.GetWorldTransform(body->GetID()));
     };
-    glfwSwapBuffers(window);
+    if (!debris.empty()) {
+      float debris_axes[3] = {cDebrisSize, cDebrisSize, cDebrisSize};
+      glUniform3fv(glGetUniformLocation(program, "axes"), 1, debris_axes);
+      for (const Debris &item: debris)
+        drawBox(program, body_interface.GetWorldTransform(item.body->GetID()));
+      glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
+    };
+    capture.endFrame();
+    pacer.swapBuffers(window);
     glfwPollEvents();
+    bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memory && !memory_down)
+      printMemoryReport(cout);
+    memory_down = memory;
+    if (capture.done())
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
     const int cCollisionSteps = 1;
-    physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+    double step_time;
+    {
+      MemoryScope scope(MemoryCategory::STEP);
+      pacer.beginPhysics();
+      if (step_stats)
+        step_stats->beginStep();
+      auto start = chrono::steady_clock::now();
+      physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+      step_time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+      pacer.endPhysics();
+    }
+    step++;
+    sim_time += dt;
+    if (step_stats)
+      step_stats->endStep(physics_system, step, sim_time);
+    if (contact_events)
+      for (const ContactEvent &event: contact_events->collect())
+        if (event.type == ContactEvent::ADDED && event.speed >= impact_speed)
+          cout << "Impact at step " << step << ": body " << event.body1.GetIndex() << " and body "
+               << event.body2.GetIndex() << " at " << event.speed << " m/s" << endl;
+    if (debris_pool) {
+      auto start = chrono::steady_clock::now();
+      uint changes = spawned + despawned;
+      for (size_t i=0; i<debris.size();) {
+        Body *body = debris[i].body;
+        debris[i].sleep = body->IsActive() ? 0.0 : debris[i].sleep + dt;
+        if (body->GetPosition().GetY() < cFallLimit || debris[i].sleep > despawn_sleep) {
+          debris_pool->release(body);
+          debris[i] = debris.back();
+          debris.pop_back();
+          despawned++;
+        } else
+          i++;
+      };
+      spawn_credit += spawn_rate * dt;
+      while (spawn_credit >= 1.0) {
+        RVec3 position(spawn_position(random), cSpawnHeight, spawn_position(random));
+        Body *body = debris_pool->acquire(position, Quat::sRandom(random));
+        if (body == nullptr) {
+          // All bodies are in use, the spawns are skipped instead of being made up for later
+          spawn_credit = 0.0;
+          break;
+        };
+        debris.push_back({body, 0.0});
+        spawned++;
+        spawn_credit -= 1.0;
+      };
+      debris_pool->flush();
+      churn_times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+      step_times.push_back(step_time);
+      // Removed bodies leave holes in the broad phase trees which are only closed by a rebuild
+      broadphase.bodiesChanged(spawned + despawned - changes);
+    };
+    // The trees also degrade as the bodies move, so their quality is checked with and without spawning
+    broadphase.afterStep(physics_system, step_time, step_stats ? step_stats->collisionTime() : -1.0);
+    if (telemetry)
+      for (uint i=0; i<boxes.size(); i++)
+        pushBody(*telemetry, step, sim_time, i, body_interface, boxes[i]->GetID());
     t += dt;
+    pacer.endFrame();
   }
 
+  debris_pool.reset();
+  if (!churn_times.empty()) {
+    size_t n = churn_times.size();
+    double churn_total = 0.0;
+    double step_total = 0.0;
+    for (size_t i=0; i<n; i++) {
+      churn_total += churn_times[i];
+      step_total += step_times[i];
+    };
+    sort(churn_times.begin(), churn_times.end());
+    printf("Spawned %u and removed %u bodies in %zu steps (%s)\n", spawned, despawned, n,
+           options.has("no-pool") ? "created and destroyed" : "pooled");
+    printf("Churn per step: mean %.4f ms, p50 %.4f ms, p95 %.4f ms, max %.4f ms (physics step: mean %.4f ms)\n",
+           churn_total / n, churn_times[n / 2], churn_times[n * 95 / 100], churn_times.back(), step_total / n);
+  };
+  broadphase.printSummary();
+
   for (int i=0; i<3; i++) {
     Body *body = boxes[i];
     body_interface.RemoveBody(body->GetID());
     body_interface.DestroyBody(body->GetID());
   };
 
+  if (step_stats)
+    step_stats->printSummary();
+  if (contact_events && contact_events->dropped() > 0)
+    cerr << "Contact event buffers overflowed, " << contact_events->dropped() << " events were dropped" << endl;
+  printMemoryReport(cout);
   UnregisterTypes();
   delete Factory::sInstance;
   Factory::sInstance = nullptr;
 
+  capture.finish();
+
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &idx);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cstdio>
+#include <Jolt/Physics/Body/Body.h>
+#include <Jolt/Physics/Body/BodyLockInterface.h>
+#include <Jolt/Physics/Constraints/TwoBodyConstraint.h>
+#include "step_stats.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+// Marks bodies which are not part of the island search
+static const uint cNoParent = ~uint(0);
+
+static double milliseconds(chrono::steady_clock::duration duration)
+{
+  return chrono::duration<double, milli>(duration).count();
+}
+
+StepStatistics::StepStatistics(const string &file_name, uint max_contact_constraints):
+  telemetry(file_name, {"step", "time", "step_ms", "collision_ms", "bodies", "active_bodies", "activated",
+                        "deactivated", "islands", "contact_pairs", "contacts", "contacts_added", "contacts_removed",
+                        "contact_budget", "constraints"}),
+  budget(max_contact_constraints), added(0), persisted(0), removed(0), activated(0), deactivated(0), num_pairs(0),
+  last_contact(0), pairs(max_contact_constraints), peak_contacts(0), peak_islands(0), peak_active(0), peak_step(0.0),
+  last_collision(0.0)
+{
+}
+
+void StepStatistics::attach(PhysicsSystem &physics_system)
+{
+  parent.assign(physics_system.GetMaxBodies(), cNoParent);
+  physics_system.SetContactListener(this);
+  physics_system.SetBodyActivationListener(this);
+}
+
+void StepStatistics::beginStep()
+{
+  added = 0;
+  persisted = 0;
+  removed = 0;
+  activated = 0;
+  deactivated = 0;
+  num_pairs = 0;
+  last_contact = 0;
+  start = Clock::now();
+}
+
+void StepStatistics::contact(const Body &body1, const Body &body2)
+{
+  // Static and kinematic bodies do not join islands
+  if (body1.IsDynamic() && body2.IsDynamic()) {
+    uint index = num_pairs.fetch_add(1, memory_order_relaxed);
+    uint a = body1.GetID().GetIndex();
+    uint b = body2.GetID().GetIndex();
+    if (index < pairs.size())
+      pairs[index] = {min(a, b), max(a, b)};
+  };
+  Clock::rep now = (Clock::now() - start).count();
+  Clock::rep last = last_contact.load(memory_order_relaxed);
+  while (last < now && !last_contact.compare_exchange_weak(last, now, memory_order_relaxed));
+}
+
+void StepStatistics::OnContactAdded(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold,
+                                    ContactSettings &ioSettings)
+{
+  added.fetch_add(1, memory_order_relaxed);
+  contact(inBody1, inBody2);
+}
+
+void StepStatistics::OnContactPersisted(const Body &inBody1, const Body &inBody2, const ContactManifold &inManifold,
+                                        ContactSettings &ioSettings)
+{
+  persisted.fetch_add(1, memory_order_relaxed);
+  contact(inBody1, inBody2);
+}
+
+void StepStatistics::OnContactRemoved(const SubShapeIDPair &inSubShapePair)
+{
+  removed.fetch_add(1, memory_order_relaxed);
+}
+
+void StepStatistics::OnBodyActivated(const BodyID &inBodyID, uint64 inBodyUserData)
+{
+  activated.fetch_add(1, memory_order_relaxed);
+}
+
+void StepStatistics::OnBodyDeactivated(const BodyID &inBodyID, uint64 inBodyUserData)
+{
+  deactivated.fetch_add(1, memory_order_relaxed);
+}
+
+uint StepStatistics::find(uint index)
+{
+  while (parent[index] != index) {
+    parent[index] = parent[parent[index]];
+    index = parent[index];
+  };
+  return index;
+}
+
+void StepStatistics::endStep(PhysicsSystem &physics_system, uint64 step, double time)
+{
+  double step_time = milliseconds(Clock::now() - start);
+  double collision_time = milliseconds(Clock::duration(last_contact.load()));
+  last_collision = collision_time;
+
+  // Union-find over the active dynamic bodies, the callbacks are done so the pairs can be read without locking
+  const BodyLockInterfaceNoLock &lock_interface = physics_system.GetBodyLockInterfaceNoLock();
+  physics_system.GetActiveBodies(EBodyType::RigidBody, active);
+  uint num_dynamic = 0;
+  for (const BodyID &id: active) {
+    const Body *body = lock_interface.TryGetBody(id);
+    if (body != nullptr && body->IsDynamic()) {
+      parent[id.GetIndex()] = id.GetIndex();
+      num_dynamic++;
+    };
+  };
+  uint islands = num_dynamic;
+  auto join = [&](uint a, uint b) {
+    if (parent[a] == cNoParent || parent[b] == cNoParent)
+      return;
+    a = find(a);
+    b = find(b);
+    if (a != b) {
+      parent[a] = b;
+      islands--;
+    };
+  };
+  uint num_contacts = added + persisted;
+  uint recorded = min<uint>(num_pairs, pairs.size());
+  for (uint i=0; i<recorded; i++)
+    join(pairs[i].first, pairs[i].second);
+  uint num_constraints = 0;
+  for (const Ref<Constraint> &constraint: physics_system.GetConstraints()) {
+    if (!constraint->IsActive())
+      continue;
+    num_constraints++;
+    if (constraint->GetType() != EConstraintType::TwoBodyConstraint)
+      continue;
+    const TwoBodyConstraint *joint = static_cast<const TwoBodyConstraint *>(constraint.GetPtr());
+    if (joint->GetBody1()->IsDynamic() && joint->GetBody2()->IsDynamic())
+      join(joint->GetBody1()->GetID().GetIndex(), joint->GetBody2()->GetID().GetIndex());
+  };
+  for (const BodyID &id: active)
+    parent[id.GetIndex()] = cNoParent;
+
+  // Body pairs with several manifolds (e.g. touching sub shapes of compounds) are counted once
+  sort(pairs.begin(), pairs.begin() + recorded);
+  uint distinct = unique(pairs.begin(), pairs.begin() + recorded) - pairs.begin();
+
+  double row[] = {(double)step, time, step_time, collision_time, (double)physics_system.GetNumBodies(),
+                  (double)active.size(), (double)activated, (double)deactivated, (double)islands, (double)distinct,
+                  (double)num_contacts, (double)added, (double)removed, (double)budget, (double)num_constraints};
+  telemetry.push(row);
+  peak_contacts = max(peak_contacts, num_contacts);
+  peak_islands = max(peak_islands, islands);
+  peak_active = max(peak_active, (uint)active.size());
+  peak_step = max(peak_step, step_time);
+}
+
+void StepStatistics::printSummary() const
+{
+  printf("Peak contacts %u of %u (%.1f%%), peak islands %u, peak active bodies %u, longest step %.3f ms\n",
+         peak_contacts, budget, 100.0 * peak_contacts / max(budget, 1u), peak_islands, peak_active, peak_step);
+  if (peak_contacts >= budget)
+    printf("The contact constraint budget was exhausted, contacts were dropped\n");
+}
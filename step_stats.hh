@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Body/BodyActivationListener.h>
+#include <Jolt/Physics/Collision/ContactListener.h>
+#include "telemetry.hh"
+
+// Island and contact statistics of each physics step, written as telemetry rows ("--step-stats FILE").
+//
+// The statistics are gathered by a contact listener and a body activation listener, so they replace any other
+// listener of the physics system. The callbacks run on the job threads and only update atomic counters and a
+// preallocated list of the body pairs in contact. After the step the islands are found by joining the active dynamic
+// bodies along these pairs and the enabled two body constraints. They match the islands of the solver except for
+// contacts that were disabled by the listener or the collision filters.
+//
+// Columns: step, time, step_ms (duration of the update), collision_ms (time from the start of the update to the last
+// contact callback), bodies, active_bodies, activated, deactivated, islands, contact_pairs (distinct pairs of dynamic
+// bodies in contact), contacts (contact constraints, one per manifold), contacts_added, contacts_removed,
+// contact_budget (maximum number of contact constraints) and constraints (active constraints passed to the solver).
+// Jolt does not report the duration of its phases without the profiler, collision_ms approximates the broad and narrow
+// phase as all contacts are found before the solver starts.
+class StepStatistics: public JPH::ContactListener, public JPH::BodyActivationListener
+{
+  public:
+    StepStatistics(const std::string &file_name, JPH::uint max_contact_constraints);
+    void attach(JPH::PhysicsSystem &physics_system);
+    void beginStep();
+    void endStep(JPH::PhysicsSystem &physics_system, JPH::uint64 step, double time);
+    // Print the peak values of the run
+    void printSummary() const;
+    // collision_ms of the last step
+    double collisionTime() const { return last_collision; }
+    virtual void OnContactAdded(const JPH::Body &inBody1, const JPH::Body &inBody2,
+                                const JPH::ContactManifold &inManifold, JPH::ContactSettings &ioSettings) override;
+    virtual void OnContactPersisted(const JPH::Body &inBody1, const JPH::Body &inBody2,
+                                    const JPH::ContactManifold &inManifold, JPH::ContactSettings &ioSettings) override;
+    virtual void OnContactRemoved(const JPH::SubShapeIDPair &inSubShapePair) override;
+    virtual void OnBodyActivated(const JPH::BodyID &inBodyID, JPH::uint64 inBodyUserData) override;
+    virtual void OnBodyDeactivated(const JPH::BodyID &inBodyID, JPH::uint64 inBodyUserData) override;
+  private:
+    typedef std::chrono::steady_clock Clock;
+    void contact(const JPH::Body &body1, const JPH::Body &body2);
+    JPH::uint find(JPH::uint index);
+    Telemetry telemetry;
+    JPH::uint budget;
+    Clock::time_point start;
+    std::atomic<JPH::uint> added;
+    std::atomic<JPH::uint> persisted;
+    std::atomic<JPH::uint> removed;
+    std::atomic<JPH::uint> activated;
+    std::atomic<JPH::uint> deactivated;
+    std::atomic<JPH::uint> num_pairs;
+    std::atomic<Clock::rep> last_contact;
+    std::vector<std::pair<JPH::uint, JPH::uint>> pairs;
+    std::vector<JPH::uint> parent;
+    JPH::BodyIDVector active;
+    JPH::uint peak_contacts;
+    JPH::uint peak_islands;
+    JPH::uint peak_active;
+    double peak_step;
+    double last_collision;
+};
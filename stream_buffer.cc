@@ -0,0 +1,84 @@
+#include <algorithm>
+#include "stream_buffer.hh"
+
+
+using namespace std;
+
+// Regions start at multiples of this to keep the attribute offsets aligned
+static const size_t cRegionAlignment = 256;
+
+StreamBuffer::StreamBuffer(GLenum target, size_t size, bool persistent):
+  target(target), size((max(size, (size_t)1) + cRegionAlignment - 1) / cRegionAlignment * cRegionAlignment),
+  storage(persistent), current(0), id(0), mapping(nullptr), waits(0)
+{
+  for (int i=0; i<cNumRegions; i++)
+    fences[i] = nullptr;
+}
+
+void StreamBuffer::init()
+{
+  glGenBuffers(1, &id);
+  glBindBuffer(target, id);
+  if (storage && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(target, cNumRegions * size, NULL, flags);
+    mapping = (char *)glMapBufferRange(target, 0, cNumRegions * size, flags);
+    if (mapping == nullptr) {
+      // The storage of the buffer is immutable, start over with a new one
+      glDeleteBuffers(1, &id);
+      glGenBuffers(1, &id);
+      glBindBuffer(target, id);
+    };
+  };
+  if (mapping == nullptr) {
+    glBufferData(target, cNumRegions * size, NULL, GL_STREAM_DRAW);
+    staging.resize(size);
+  };
+}
+
+void *StreamBuffer::map()
+{
+  if (fences[current] != nullptr) {
+    // This only blocks if the GPU is more than two frames behind
+    if (glClientWaitSync(fences[current], 0, 0) == GL_TIMEOUT_EXPIRED) {
+      waits++;
+      glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    };
+    glDeleteSync(fences[current]);
+    fences[current] = nullptr;
+  };
+  return mapping != nullptr ? mapping + current * size : staging.data();
+}
+
+size_t StreamBuffer::unmap(size_t used)
+{
+  if (mapping == nullptr && used > 0) {
+    glBindBuffer(target, id);
+    glBufferSubData(target, current * size, min(used, size), staging.data());
+  };
+  return current * size;
+}
+
+void StreamBuffer::fence()
+{
+  // The driver keeps track of the regions uploaded with glBufferSubData
+  if (mapping != nullptr)
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  current = (current + 1) % cNumRegions;
+}
+
+void StreamBuffer::finish()
+{
+  for (int i=0; i<cNumRegions; i++)
+    if (fences[i] != nullptr) {
+      glDeleteSync(fences[i]);
+      fences[i] = nullptr;
+    };
+  glBindBuffer(target, id);
+  if (mapping != nullptr) {
+    glUnmapBuffer(target);
+    mapping = nullptr;
+  };
+  glBindBuffer(target, 0);
+  glDeleteBuffers(1, &id);
+}
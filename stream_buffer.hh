@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+
+// Buffer for vertex or instance data written by the CPU every frame.
+//
+// The buffer is a ring of three regions of the given size. Each frame writes the next region while the GPU may still
+// be reading the previous ones, and a fence placed after the draw calls of a frame keeps its region from being
+// overwritten before the GPU has finished with it. With OpenGL 4.4 or ARB_buffer_storage the buffer is mapped
+// persistently and coherently, so the data is written straight into memory visible to the GPU without any map, unmap
+// or upload calls. Otherwise (e.g. the OpenGL 4.1 contexts on macOS) the data is staged in system memory and uploaded
+// into the region with glBufferSubData.
+//
+// Usage per frame: write the data to map(), call unmap() with the number of bytes written to get the offset of the
+// region in the buffer for the attribute pointers, issue the draw calls and call fence().
+class StreamBuffer
+{
+  public:
+    StreamBuffer(GLenum target, size_t size, bool persistent = true);
+    void init();
+    void *map();
+    size_t unmap(size_t used);
+    void fence();
+    void finish();
+    GLuint buffer() const { return id; }
+    bool persistent() const { return mapping != nullptr; }
+    // Number of times map() had to wait for the GPU to release a region
+    uint64_t stalls() const { return waits; }
+  private:
+    static const int cNumRegions = 3;
+    GLenum target;
+    size_t size;
+    bool storage;
+    int current;
+    GLuint id;
+    char *mapping;
+    GLsync fences[cNumRegions];
+    uint64_t waits;
+    std::vector<char> staging;
+};
@@ -1,4 +1,9 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
 #include <cstdarg>
 #include <thread>
 #include <Jolt/Jolt.h>
@@ -16,6 +21,12 @@
 #include <Jolt/Physics/Constraints/SliderConstraint.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "options.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "physics_settings.hh"
+#include "allocator.hh"
+#include "frame_pacer.hh"
 
 
 using namespace std;
@@ -92,6 +103,8 @@ int height = 720;
 
 const char *vertexSource = "#version 410 core\n\
 uniform float aspect;\n\
+uniform float scale;\n\
+uniform mat3 view;\n\
 uniform vec3 axes;\n\
 uniform vec3 translation;\n\
 uniform mat3 rotation;\n\
@@ -100,8 +113,8 @@ in vec3 normal;\n\
 out vec3 n;\n\
 void main()\n\
 {\n\
-  n = rotation * normal;\n\
-  gl_Position = vec4((rotation * (point * axes) + translation) * vec3(1, aspect, 1), 1);\n\
+  n = view * rotation * normal;\n\
+  gl_Position = vec4(view * (rotation * (point * axes) + translation) * scale * vec3(1, aspect, 1), 1);\n\
 }";
 
 const char *fragmentSource = "#version 410 core\n\
@@ -155,12 +168,12 @@ GLfloat vertices[] = {
 };
 
 unsigned int indices[] = {
-   0,  1,  2,  3,
-   4,  5,  6,  7,
-   8,  9, 10, 11,
-  12, 13, 14, 15,
-  16, 17, 18, 19,
-  20, 21, 22, 23
+   0,  1,  2,  0,  2,  3,
+   4,  5,  6,  4,  6,  7,
+   8,  9, 10,  8, 10, 11,
+  12, 13, 14, 12, 14, 15,
+  16, 17, 18, 16, 18, 19,
+  20, 21, 22, 20, 22, 23
 };
 
 void handleCompileError(const char *step, GLuint shader)
@@ -187,71 +200,181 @@ void handleLinkError(const char *step, GLuint program)
   };
 }
 
-int main(void)
+const uint cNumBodyMutexes = 0;
+const float cBoxSize = 0.1f;
+const float cRestLength = 0.4f;
+const float cRigSpacing = 0.3f;
+
+// Two boxes connected by a slider and a spring. The extrema of the spring extension are recorded to measure the
+// frequency and damping of the oscillation.
+struct Rig
+{
+  Body *lower;
+  Body *upper;
+  float frequency;
+  float damping;
+  float previous_velocity;
+  bool settled;
+  vector<double> times;
+  vector<double> extensions;
+};
+
+static Body *createBox(BodyInterface &body_interface, const Shape *shape, RVec3Arg position)
+{
+  BodyCreationSettings body_settings(shape, position, Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
+  body_settings.mApplyGyroscopicForce = true;
+  body_settings.mLinearDamping = 0.0;
+  body_settings.mAngularDamping = 0.0;
+  body_settings.mMotionQuality = EMotionQuality::LinearCast;
+  body_settings.mAllowSleeping = false;
+  Body *body = body_interface.CreateBody(body_settings);
+  body->SetFriction(0.5);
+  body->SetRestitution(0.3);
+  body_interface.AddBody(body->GetID(), EActivation::Activate);
+  return body;
+}
+
+static Rig createRig(PhysicsSystem &physics_system, const Shape *shape, RVec3Arg position, float frequency, float damping)
+{
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  Rig rig;
+  RVec3 top = position + Vec3(0.0f, cRestLength, 0.0f);
+  rig.lower = createBox(body_interface, shape, position);
+  rig.upper = createBox(body_interface, shape, top);
+  rig.frequency = frequency;
+  rig.damping = damping;
+  rig.previous_velocity = 0.0f;
+  rig.settled = false;
+
+  SliderConstraintSettings slider_settings;
+  slider_settings.mAutoDetectPoint = true;
+  slider_settings.SetSliderAxis(Vec3::sAxisY());
+  physics_system.AddConstraint(slider_settings.Create(*rig.lower, *rig.upper));
+
+  DistanceConstraintSettings distance_settings;
+  distance_settings.mPoint1 = position;
+  distance_settings.mPoint2 = top;
+  distance_settings.mLimitsSpringSettings.mDamping = damping;
+  distance_settings.mLimitsSpringSettings.mStiffness = frequency;
+  physics_system.AddConstraint(distance_settings.Create(*rig.lower, *rig.upper));
+  return rig;
+}
+
+// Record an extremum of the spring extension whenever the relative velocity changes its sign
+static void trackRig(Rig &rig, const BodyInterface &body_interface, double time)
+{
+  if (rig.settled)
+    return;
+  float velocity = body_interface.GetLinearVelocity(rig.upper->GetID()).GetY() -
+                   body_interface.GetLinearVelocity(rig.lower->GetID()).GetY();
+  if (velocity * rig.previous_velocity < 0.0f) {
+    double extension = body_interface.GetPosition(rig.upper->GetID()).GetY() -
+                       body_interface.GetPosition(rig.lower->GetID()).GetY();
+    // Stop once the oscillation has decayed into numerical noise
+    if (!rig.extensions.empty() && fabs(extension - rig.extensions.back()) < 1e-6)
+      rig.settled = true;
+    else {
+      rig.times.push_back(time);
+      rig.extensions.push_back(extension);
+    };
+  };
+  if (velocity != 0.0f)
+    rig.previous_velocity = velocity;
+}
+
+// Damped frequency and damping ratio from the recorded extrema (logarithmic decrement of the half peak-to-peak amplitudes)
+static bool measureRig(const Rig &rig, double &frequency, double &damping)
+{
+  size_t n = rig.times.size();
+  if (n < 3)
+    return false;
+  frequency = (n - 1) / (2.0 * (rig.times[n - 1] - rig.times[0]));
+  double first = 0.5 * fabs(rig.extensions[1] - rig.extensions[0]);
+  double last = 0.5 * fabs(rig.extensions[n - 1] - rig.extensions[n - 2]);
+  if (first <= 0.0 || last <= 0.0)
+    return false;
+  double decrement = 2.0 * log(first / last) / (n - 2);
+  damping = decrement / sqrt(4.0 * JPH_PI * JPH_PI + decrement * decrement);
+  return true;
+}
+
+// The spring frequency of Jolt refers to the effective mass of both bodies. With the lower box resting on the ground
+// only the upper box oscillates which lowers the natural frequency and the damping ratio by sqrt(m1 / (m1 + m2)).
+static void analyseRig(const Rig &rig, double &frequency, double &damping)
+{
+  double m1 = 1.0 / rig.lower->GetMotionProperties()->GetInverseMass();
+  double m2 = 1.0 / rig.upper->GetMotionProperties()->GetInverseMass();
+  double ratio = sqrt(m1 / (m1 + m2));
+  damping = rig.damping * ratio;
+  frequency = rig.frequency * ratio * sqrt(max(0.0, 1.0 - damping * damping));
+}
+
+// Run a grid of rigs without window and compare the oscillation with the analytic solution
+static void benchmark(const Options &options, PhysicsSystem &physics_system, vector<Rig> &rigs, TempAllocator &temp_allocator,
+                      JobSystem &job_system)
 {
-  glfwInit();
-  GLFWwindow *window = glfwCreateWindow(width, height, "Suspension simulation with Jolt Physics", NULL, NULL);
-  glfwMakeContextCurrent(window);
-  glewInit();
-
-  glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
-  glViewport(0, 0, width, height);
-
-  GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexSource, NULL);
-  glCompileShader(vertexShader);
-  handleCompileError("Vertex shader", vertexShader);
-
-  GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
-  glCompileShader(fragmentShader);
-  handleCompileError("Fragment shader", fragmentShader);
-
-  GLuint program = glCreateProgram();
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
-  handleLinkError("Shader program", program);
-
-  GLuint vao;
-  GLuint vbo;
-  GLuint idx;
-
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  glGenBuffers(1, &vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  glGenBuffers(1, &idx);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  glUseProgram(program);
-
-  glVertexAttribPointer(glGetAttribLocation(program, "point"),
-                        3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(float), (void *)0);
-  glVertexAttribPointer(glGetAttribLocation(program, "normal"),
-                        3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(float), (void *)(3 * sizeof(float)));
-
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-
-  glDisable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
-
-  float light[3] = {0.36f, 0.8f, -0.48f};
-  glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
-  glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  float a = 0.1;
-  float b = 0.1;
-  float c = 0.1;
-  float axes[3] = {a, b, c};
-  glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
-
-  RegisterDefaultAllocator();
+  int steps = options.getInt("steps", 600);
+  double dt = options.getDouble("dt", 1.0 / 60.0);
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  vector<double> times;
+  times.reserve(steps);
+  for (int i=0; i<steps; i++) {
+    auto start = chrono::steady_clock::now();
+    {
+      MemoryScope scope(MemoryCategory::STEP);
+      physics_system.Update(dt, 1, &temp_allocator, &job_system);
+    }
+    times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    for (Rig &rig: rigs)
+      trackRig(rig, body_interface, (i + 1) * dt);
+  };
+  if (times.empty())
+    return;
+  double total = 0.0;
+  for (double time: times)
+    total += time;
+  sort(times.begin(), times.end());
+  printf("%zu rigs (%zu constraints), %d steps of %.6f s: mean %.4f ms, p95 %.4f ms, %.3f us per rig\n",
+         rigs.size(), 2 * rigs.size(), steps, dt, total / steps, times[steps * 95 / 100], 1000.0 * total / steps / rigs.size());
+
+  int grid = (int)round(sqrt((double)rigs.size()));
+  int unmeasured = 0;
+  double frequency_error = 0.0, max_frequency_error = 0.0, damping_error = 0.0, max_damping_error = 0.0;
+  printf("%10s %10s %12s %12s %10s %12s %12s\n", "spring/Hz", "ratio", "analytic/Hz", "measured/Hz", "error", "analytic", "measured");
+  for (size_t i=0; i<rigs.size(); i++) {
+    double frequency, damping, expected_frequency, expected_damping;
+    analyseRig(rigs[i], expected_frequency, expected_damping);
+    if (!measureRig(rigs[i], frequency, damping)) {
+      unmeasured++;
+      continue;
+    };
+    double error = frequency / expected_frequency - 1.0;
+    frequency_error += fabs(error);
+    max_frequency_error = max(max_frequency_error, fabs(error));
+    damping_error += fabs(damping - expected_damping);
+    max_damping_error = max(max_damping_error, fabs(damping - expected_damping));
+    // Print the diagonal of the grid
+    if (grid > 0 && i % grid == i / grid)
+      printf("%10.3f %10.3f %12.4f %12.4f %+10.4f %12.4f %12.4f\n", rigs[i].frequency, rigs[i].damping, expected_frequency,
+             frequency, error, expected_damping, damping);
+  };
+  size_t measured = rigs.size() - unmeasured;
+  if (measured > 0)
+    printf("frequency error: mean %.4f, max %.4f; damping ratio error: mean %.4f, max %.4f\n",
+           frequency_error / measured, max_frequency_error, damping_error / measured, max_damping_error);
+  if (unmeasured > 0)
+    printf("%d rigs did not complete enough oscillations to be measured\n", unmeasured);
+}
+
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  width = options.getInt("width", width);
+  height = options.getInt("height", height);
+  int grid = options.getInt("grid", 0);
+  Capture capture(options, width, height);
+
+  registerAllocator(options);
   Trace = TraceImpl;
   JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
   Factory::sInstance = new Factory();
@@ -260,54 +383,60 @@ int main(void)
   TempAllocatorMalloc temp_allocator;
   JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
 
-  const uint cMaxBodies = 1024;
-  const uint cNumBodyMutexes = 0;
-  const uint cMaxBodyPairs = 1024;
-  const uint cMaxContactConstraints = 1024;
+  // Each rig has two bodies, two constraints and one contact with the ground
+  const uint cNumRigs = max(grid * grid, 1);
+  const uint cMaxBodies = max(2 * cNumRigs + 16, 1024u);
+  const uint cMaxBodyPairs = max(4 * cNumRigs, 1024u);
+  const uint cMaxContactConstraints = max(4 * cNumRigs, 1024u);
   BPLayerInterfaceImpl broad_phase_layer_interface;
   ObjectLayerPairFilterImpl object_vs_object_layer_filter;
   ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
 
   PhysicsSystem physics_system;
-  physics_system.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
-                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  initPhysicsSystem(physics_system, cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                    broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
   physics_system.SetGravity(Vec3(0, -0.4, 0));
   BodyInterface &body_interface = physics_system.GetBodyInterface();
 
-  vector<Body *> boxes;
+  BoxShapeSettings body_shape_settings(Vec3(0.5 * cBoxSize, 0.5 * cBoxSize, 0.5 * cBoxSize));
+  body_shape_settings.mConvexRadius = 0.01;
+  body_shape_settings.SetDensity(1000.0);
+  body_shape_settings.SetEmbedded();
+  ShapeSettings::ShapeResult body_shape_result = body_shape_settings.Create();
+  ShapeRefC body_shape = body_shape_result.Get();
 
-  for (int i=0; i<2; i++) {
-    BoxShapeSettings body_shape_settings(Vec3(0.5 * a, 0.5 * b, 0.5 * c));
-    body_shape_settings.mConvexRadius = 0.01;
-    body_shape_settings.SetDensity(1000.0);
-    body_shape_settings.SetEmbedded();
-    ShapeSettings::ShapeResult body_shape_result = body_shape_settings.Create();
-    ShapeRefC body_shape = body_shape_result.Get();
-    BodyCreationSettings body_settings(body_shape, RVec3(0.0, i * 0.4, 0.0), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
-    body_settings.mApplyGyroscopicForce = true;
-    body_settings.mLinearDamping = 0.0;
-    body_settings.mAngularDamping = 0.0;
-    body_settings.mMotionQuality = EMotionQuality::LinearCast;
-    Body *body = body_interface.CreateBody(body_settings);
-    body->SetFriction(0.5);
-    body->SetRestitution(0.3);
-    body_interface.AddBody(body->GetID(), EActivation::Activate);
-    boxes.push_back(body);
+  vector<Rig> rigs;
+  vector<Body *> boxes;
+  float extent = 3.0;
+  if (grid > 0) {
+    // The spring frequency varies along the x-axis and the damping ratio along the z-axis. The lower boxes start resting
+    // on the ground and the upper boxes start with different upward velocities, after which every rig oscillates freely
+    // so that its decay can be compared with the analytic values.
+    float min_frequency = options.getDouble("min-frequency", 0.5);
+    float max_frequency = options.getDouble("max-frequency", 4.0);
+    float min_damping = options.getDouble("min-damping", 0.0);
+    float max_damping = options.getDouble("max-damping", 0.5);
+    float initial_velocity = options.getDouble("initial-velocity", 0.02);
+    extent = max(extent, 0.5f * grid * cRigSpacing + 1.0f);
+    for (int i=0; i<grid; i++)
+      for (int j=0; j<grid; j++) {
+        float u = grid > 1 ? (float)j / (grid - 1) : 0.0f;
+        float v = grid > 1 ? (float)i / (grid - 1) : 0.0f;
+        RVec3 position((j - 0.5 * (grid - 1)) * cRigSpacing, -0.4 + 0.5 * cBoxSize, (i - 0.5 * (grid - 1)) * cRigSpacing);
+        Rig rig = createRig(physics_system, body_shape, position, min_frequency + u * (max_frequency - min_frequency),
+                            min_damping + v * (max_damping - min_damping));
+        body_interface.SetLinearVelocity(rig.upper->GetID(), Vec3(0.0f, initial_velocity * (1 + (i + j) % 4) / 4, 0.0f));
+        rigs.push_back(rig);
+      };
+  } else
+    rigs.push_back(createRig(physics_system, body_shape, RVec3::sZero(), 1.0f, 0.1f));
+  for (const Rig &rig: rigs) {
+    boxes.push_back(rig.lower);
+    boxes.push_back(rig.upper);
   };
 
-  SliderConstraintSettings slider_settings;
-  slider_settings.mAutoDetectPoint = true;
-  slider_settings.SetSliderAxis(Vec3::sAxisY());
-  physics_system.AddConstraint(slider_settings.Create(*boxes[0], *boxes[1]));
-
-  DistanceConstraintSettings distance_settings;
-  distance_settings.mPoint1 = RVec3(0.0, 0.0, 0.0);
-  distance_settings.mPoint2 = RVec3(0.0, 0.4, 0.0);
-  distance_settings.mLimitsSpringSettings.mDamping = 0.1f;
-  distance_settings.mLimitsSpringSettings.mStiffness = 1.0f;
-  physics_system.AddConstraint(distance_settings.Create(*boxes[0], *boxes[1]));
-
-  BoxShapeSettings ground_shape_settings(Vec3(3.0, 0.1, 3.0));
+  BoxShapeSettings ground_shape_settings(Vec3(extent, 0.1, extent));
   ground_shape_settings.mConvexRadius = 0.01;
   ground_shape_settings.SetEmbedded();
   ShapeSettings::ShapeResult ground_shape_result = ground_shape_settings.Create();
@@ -319,52 +448,160 @@ int main(void)
 
   physics_system.OptimizeBroadPhase();
 
-  double t = glfwGetTime();
-  while (!glfwWindowShouldClose(window)) {
-    double dt = glfwGetTime() - t;
-    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-    for (int i=0; i<2; i++) {
-      Body *body = boxes[i];
-      body_interface.ActivateBody(body->GetID());
-      RMat44 transform = body_interface.GetWorldTransform(body->GetID());
-      RVec3 position = transform.GetTranslation();
-      Vec3 x = transform.GetAxisX();
-      Vec3 y = transform.GetAxisY();
-      Vec3 z = transform.GetAxisZ();
-      float translation[3] = {(float)position.GetX(), (float)position.GetY(), (float)position.GetZ()};
-      glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
-      float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
-      glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
-      glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
-    };
-    glfwSwapBuffers(window);
-    glfwPollEvents();
-    const int cCollisionSteps = 1;
-    physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
-    t += dt;
-  }
+  if (options.has("steps")) {
+    benchmark(options, physics_system, rigs, temp_allocator, job_system);
+  } else {
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    capture.hints();
+    GLFWwindow *window = glfwCreateWindow(width, height, "Suspension simulation with Jolt Physics", NULL, NULL);
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    glewInit();
+    capture.init();
+    FramePacer pacer(options);
+
+    glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
+    glViewport(0, 0, width, height);
+
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexSource, NULL);
+    glCompileShader(vertexShader);
+    handleCompileError("Vertex shader", vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+    glCompileShader(fragmentShader);
+    handleCompileError("Fragment shader", fragmentShader);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, 0, "point");
+    glBindAttribLocation(program, 1, "normal");
+    glLinkProgram(program);
+    handleLinkError("Shader program", program);
+
+    GLuint vao;
+    GLuint vbo;
+    GLuint idx;
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glGenBuffers(1, &idx);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glUseProgram(program);
+
+    glVertexAttribPointer(glGetAttribLocation(program, "point"),
+                          3, GL_FLOAT, GL_FALSE,
+                          6 * sizeof(float), (void *)0);
+    glVertexAttribPointer(glGetAttribLocation(program, "normal"),
+                          3, GL_FLOAT, GL_FALSE,
+                          6 * sizeof(float), (void *)(3 * sizeof(float)));
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+
+    float light[3] = {0.36f, 0.8f, -0.48f};
+    glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
+    glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
+    float axes[3] = {cBoxSize, cBoxSize, cBoxSize};
+    glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
+    // The grid is seen from above at an angle so that the rows do not overlap
+    float tilt = grid > 0 ? DegreesToRadians(30.0f) : 0.0f;
+    float view[9] = {1.0f, 0.0f, 0.0f, 0.0f, cosf(tilt), -sinf(tilt), 0.0f, sinf(tilt), cosf(tilt)};
+    glUniformMatrix3fv(glGetUniformLocation(program, "view"), 1, GL_TRUE, view);
+    glUniform1f(glGetUniformLocation(program, "scale"), grid > 0 ? 1.0f / extent : 1.0f);
+
+    unique_ptr<Telemetry> telemetry;
+    if (options.has("telemetry"))
+      telemetry.reset(new Telemetry(options.getString("telemetry", ""), stateColumns()));
+    uint64 step = 0;
+    double sim_time = 0.0;
+
+    // Key M prints the memory report
+    bool memory_down = false;
+    pacer.init();
+    double t = glfwGetTime();
+    while (!glfwWindowShouldClose(window)) {
+      double dt = capture.enabled() ? capture.timestep() : glfwGetTime() - t;
+      capture.beginFrame();
+      glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+      for (Body *body: boxes) {
+        RMat44 transform = body_interface.GetWorldTransform(body->GetID());
+        RVec3 position = transform.GetTranslation();
+        Vec3 x = transform.GetAxisX();
+        Vec3 y = transform.GetAxisY();
+        Vec3 z = transform.GetAxisZ();
+        float translation[3] = {(float)position.GetX(), (float)position.GetY(), (float)position.GetZ()};
+        glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
+        float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
+        glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
+      };
+      capture.endFrame();
+      pacer.swapBuffers(window);
+      glfwPollEvents();
+      bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+      if (memory && !memory_down)
+        printMemoryReport(cout);
+      memory_down = memory;
+      if (capture.done())
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+      const int cCollisionSteps = 1;
+      {
+        MemoryScope scope(MemoryCategory::STEP);
+        pacer.beginPhysics();
+        physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+        pacer.endPhysics();
+      }
+      step++;
+      sim_time += dt;
+      if (telemetry)
+        for (uint i=0; i<boxes.size(); i++)
+          pushBody(*telemetry, step, sim_time, i, body_interface, boxes[i]->GetID());
+      t += dt;
+      pacer.endFrame();
+    }
+
+    capture.finish();
 
-  for (int i=0; i<2; i++) {
-    Body *body = boxes[i];
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &idx);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &vbo);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vao);
+
+    glDeleteProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    glfwTerminate();
+  };
+
+  for (Body *body: boxes) {
     body_interface.RemoveBody(body->GetID());
     body_interface.DestroyBody(body->GetID());
   };
+  body_interface.RemoveBody(ground->GetID());
+  body_interface.DestroyBody(ground->GetID());
 
+  printMemoryReport(cout);
   UnregisterTypes();
   delete Factory::sInstance;
   Factory::sInstance = nullptr;
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glDeleteBuffers(1, &idx);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glDeleteBuffers(1, &vbo);
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &vao);
-
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-
-  glfwTerminate();
   return 0;
 }
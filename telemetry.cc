@@ -0,0 +1,162 @@
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include "telemetry.hh"
+
+
+using namespace std;
+using namespace JPH;
+
+static void writeWord(FILE *file, uint32_t value)
+{
+  unsigned char bytes[4] = {(unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24)};
+  fwrite(bytes, 1, 4, file);
+}
+
+Telemetry::Telemetry(const string &file_name, const vector<string> &columns, size_t capacity):
+  columns(columns), output(fopen(file_name.c_str(), "wb")),
+  csv(file_name.size() >= 4 && file_name.compare(file_name.size() - 4, 4, ".csv") == 0),
+  queue(capacity * columns.size()), capacity(capacity), head(0), count(0), lost(0), stopping(false)
+{
+  if (output == nullptr) {
+    cerr << "Could not open telemetry file " << file_name << endl;
+    return;
+  };
+  writeHeader();
+  writer = thread(&Telemetry::run, this);
+}
+
+Telemetry::~Telemetry()
+{
+  if (output == nullptr)
+    return;
+  {
+    lock_guard<std::mutex> lock(queue_mutex);
+    stopping = true;
+  }
+  ready.notify_one();
+  writer.join();
+  fclose(output);
+  if (lost > 0)
+    cerr << "Telemetry queue overflowed, " << lost << " rows were dropped" << endl;
+}
+
+bool Telemetry::push(const double *row)
+{
+  if (output == nullptr)
+    return false;
+  size_t n = columns.size();
+  bool notify;
+  {
+    lock_guard<std::mutex> lock(queue_mutex);
+    if (count == capacity) {
+      lost++;
+      return false;
+    };
+    copy(row, row + n, queue.begin() + ((head + count) % capacity) * n);
+    count++;
+    notify = count % cBlockSize == 0;
+  }
+  if (notify)
+    ready.notify_one();
+  return true;
+}
+
+size_t Telemetry::dropped() const
+{
+  lock_guard<std::mutex> lock(queue_mutex);
+  return lost;
+}
+
+void Telemetry::run()
+{
+  size_t n = columns.size();
+  vector<double> block(cBlockSize * n);
+  while (true) {
+    size_t rows;
+    bool done;
+    {
+      unique_lock<std::mutex> lock(queue_mutex);
+      ready.wait_for(lock, chrono::milliseconds(100), [this]{ return stopping || count >= cBlockSize; });
+      rows = min(count, cBlockSize);
+      for (size_t i=0; i<rows; i++)
+        copy(queue.begin() + ((head + i) % capacity) * n, queue.begin() + ((head + i) % capacity + 1) * n, block.begin() + i * n);
+      head = (head + rows) % capacity;
+      count -= rows;
+      done = stopping && count == 0;
+    }
+    if (rows > 0)
+      writeBlock(block, rows);
+    if (done)
+      break;
+  };
+  fflush(output);
+}
+
+void Telemetry::writeHeader()
+{
+  if (csv) {
+    for (size_t i=0; i<columns.size(); i++)
+      fprintf(output, i == 0 ? "%s" : ",%s", columns[i].c_str());
+    fprintf(output, "\n");
+  } else {
+    fwrite("JTEL", 1, 4, output);
+    writeWord(output, columns.size());
+    for (auto column=columns.begin(); column!=columns.end(); column++) {
+      writeWord(output, column->size());
+      fwrite(column->data(), 1, column->size(), output);
+    };
+  };
+}
+
+void Telemetry::writeBlock(const vector<double> &block, size_t rows)
+{
+  size_t n = columns.size();
+  if (csv) {
+    for (size_t i=0; i<rows; i++)
+      for (size_t j=0; j<n; j++)
+        fprintf(output, j == n - 1 ? "%.9g\n" : "%.9g,", block[i * n + j]);
+  } else {
+    // Transpose rows into columns
+    vector<double> column(rows);
+    writeWord(output, rows);
+    for (size_t j=0; j<n; j++) {
+      for (size_t i=0; i<rows; i++)
+        column[i] = block[i * n + j];
+      fwrite(column.data(), sizeof(double), rows, output);
+    };
+  };
+}
+
+vector<string> stateColumns(initializer_list<const char *> extra)
+{
+  vector<string> result = {"step", "time", "index", "x", "y", "z", "qx", "qy", "qz", "qw", "vx", "vy", "vz", "wx", "wy", "wz"};
+  result.insert(result.end(), extra.begin(), extra.end());
+  return result;
+}
+
+bool pushState(Telemetry &telemetry, uint64 step, double time, uint index, RVec3Arg position, QuatArg rotation,
+               Vec3Arg linear_velocity, Vec3Arg angular_velocity, initializer_list<double> extra)
+{
+  double state[16] = {(double)step, time, (double)index,
+                      (double)position.GetX(), (double)position.GetY(), (double)position.GetZ(),
+                      rotation.GetX(), rotation.GetY(), rotation.GetZ(), rotation.GetW(),
+                      linear_velocity.GetX(), linear_velocity.GetY(), linear_velocity.GetZ(),
+                      angular_velocity.GetX(), angular_velocity.GetY(), angular_velocity.GetZ()};
+  // The row is reused by the calling thread as records are pushed for every body and step
+  static thread_local vector<double> row;
+  size_t n = telemetry.numColumns();
+  row.assign(n, 0.0);
+  copy(state, state + min(n, (size_t)16), row.begin());
+  size_t i = 16;
+  for (auto value=extra.begin(); value!=extra.end() && i<n; value++)
+    row[i++] = *value;
+  return telemetry.push(row.data());
+}
+
+bool pushBody(Telemetry &telemetry, uint64 step, double time, uint index, const BodyInterface &body_interface,
+              const BodyID &id, initializer_list<double> extra)
+{
+  return pushState(telemetry, step, time, index, body_interface.GetPosition(id), body_interface.GetRotation(id),
+                   body_interface.GetLinearVelocity(id), body_interface.GetAngularVelocity(id), extra);
+}
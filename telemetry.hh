@@ -0,0 +1,56 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/BodyInterface.h>
+
+// Streaming output of per-step records.
+//
+// Rows are copied into a bounded queue and written by a background thread so that the simulation never waits for disk
+// I/O. When the queue is full the row is dropped and counted instead. File names ending in ".csv" produce CSV output.
+// Otherwise a binary columnar file is written: the magic "JTEL", the number of columns and the length prefixed column
+// names (all uint32 little-endian) followed by blocks of up to cBlockSize rows. Each block starts with the number of
+// rows and stores the values of each column contiguously as doubles.
+class Telemetry
+{
+  public:
+    Telemetry(const std::string &file_name, const std::vector<std::string> &columns, size_t capacity = 1 << 16);
+    ~Telemetry();
+    size_t numColumns() const { return columns.size(); }
+    bool push(const double *row);
+    size_t dropped() const;
+    static const size_t cBlockSize = 4096;
+  private:
+    void run();
+    void writeHeader();
+    void writeBlock(const std::vector<double> &block, size_t rows);
+    std::vector<std::string> columns;
+    FILE *output;
+    bool csv;
+    std::vector<double> queue;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    size_t lost;
+    bool stopping;
+    mutable std::mutex queue_mutex;
+    std::condition_variable ready;
+    std::thread writer;
+};
+
+// Columns of a state record (step, time, index, position, rotation, linear and angular velocity) and extra columns
+std::vector<std::string> stateColumns(std::initializer_list<const char *> extra = {});
+
+// Push a state record, values for the extra columns are given last
+bool pushState(Telemetry &telemetry, JPH::uint64 step, double time, JPH::uint index, JPH::RVec3Arg position,
+               JPH::QuatArg rotation, JPH::Vec3Arg linear_velocity, JPH::Vec3Arg angular_velocity,
+               std::initializer_list<double> extra = {});
+
+// Push the state record of a body
+bool pushBody(Telemetry &telemetry, JPH::uint64 step, double time, JPH::uint index, const JPH::BodyInterface &body_interface,
+              const JPH::BodyID &id, std::initializer_list<double> extra = {});
@@ -1,4 +1,8 @@
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
 #include <cstdarg>
 #include <thread>
 #include <Jolt/Jolt.h>
@@ -14,6 +18,12 @@
 #include <Jolt/Physics/Collision/Shape/BoxShape.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "options.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "physics_settings.hh"
+#include "allocator.hh"
+#include "frame_pacer.hh"
 
 
 using namespace std;
@@ -153,12 +163,12 @@ GLfloat vertices[] = {
 };
 
 unsigned int indices[] = {
-   0,  1,  2,  3,
-   4,  5,  6,  7,
-   8,  9, 10, 11,
-  12, 13, 14, 15,
-  16, 17, 18, 19,
-  20, 21, 22, 23
+   0,  1,  2,  0,  2,  3,
+   4,  5,  6,  4,  6,  7,
+   8,  9, 10,  8, 10, 11,
+  12, 13, 14, 12, 14, 15,
+  16, 17, 18, 16, 18, 19,
+  20, 21, 22, 20, 22, 23
 };
 
 void handleCompileError(const char *step, GLuint shader)
@@ -185,12 +195,204 @@ void handleLinkError(const char *step, GLuint program)
   };
 }
 
-int main(void)
+// Kinetic energy and angular momentum about the center of mass
+struct Invariants
 {
+  double energy;
+  double momentum;
+  Vec3 axis;
+};
+
+// Maximum relative drift of the invariants since the start
+struct Drift
+{
+  Invariants initial;
+  Invariants current;
+  double energy;
+  double momentum;
+  double angle;
+};
+
+static Invariants computeInvariants(const Body &body)
+{
+  // Use the principal axes of inertia and double precision to keep the rounding errors of the diagnostics small
+  const MotionProperties *motion = body.GetMotionProperties();
+  Quat principal = body.GetRotation() * motion->GetInertiaRotation();
+  Vec3 inverse_inertia = motion->GetInverseInertiaDiagonal();
+  Vec3 omega = principal.Conjugated() * body.GetAngularVelocity();
+  Vec3 velocity = body.GetLinearVelocity();
+  Invariants result;
+  result.energy = 0.5 * velocity.LengthSq() / motion->GetInverseMass();
+  double momentum[3];
+  for (int i=0; i<3; i++) {
+    momentum[i] = omega[i] / inverse_inertia[i];
+    result.energy += 0.5 * momentum[i] * omega[i];
+  };
+  result.momentum = sqrt(momentum[0] * momentum[0] + momentum[1] * momentum[1] + momentum[2] * momentum[2]);
+  result.axis = (principal * Vec3((float)momentum[0], (float)momentum[1], (float)momentum[2])).NormalizedOr(Vec3::sZero());
+  return result;
+}
+
+static Drift startDrift(const Invariants &initial)
+{
+  Drift result;
+  result.initial = initial;
+  result.current = initial;
+  result.energy = 0.0;
+  result.momentum = 0.0;
+  result.angle = 0.0;
+  return result;
+}
+
+static void updateDrift(Drift &drift, const Invariants &current)
+{
+  drift.current = current;
+  drift.energy = max(drift.energy, fabs(current.energy / drift.initial.energy - 1.0));
+  drift.momentum = max(drift.momentum, fabs(current.momentum / drift.initial.momentum - 1.0));
+  drift.angle = max(drift.angle, (double)acos(min(1.0f, current.axis.Dot(drift.initial.axis))));
+}
+
+static void printDrift(ostream &stream, const Drift &drift, uint64 steps)
+{
+  double energy = drift.current.energy / drift.initial.energy - 1.0;
+  double momentum = drift.current.momentum / drift.initial.momentum - 1.0;
+  stream << "steps " << steps
+         << ", energy " << drift.current.energy << " J (drift " << energy << ", per step " << energy / max(steps, (uint64)1)
+         << ", max " << drift.energy << ")"
+         << ", angular momentum " << drift.current.momentum << " kg m^2/s (drift " << momentum
+         << ", per step " << momentum / max(steps, (uint64)1) << ", max " << drift.momentum << ")"
+         << ", axis deviation " << RadiansToDegrees((float)drift.angle) << " deg" << endl;
+}
+
+static const float a = 1.0;
+static const float b = 0.1;
+static const float c = 0.5;
+
+const uint cMaxBodies = 1024;
+const uint cNumBodyMutexes = 0;
+const uint cMaxBodyPairs = 1024;
+const uint cMaxContactConstraints = 1024;
+
+static Body *createCuboid(BodyInterface &body_interface)
+{
+  BoxShapeSettings body_shape_settings(Vec3(a, b, c));
+  body_shape_settings.mConvexRadius = 0.01;
+  body_shape_settings.SetDensity(1000.0);
+  body_shape_settings.SetEmbedded();
+  ShapeSettings::ShapeResult body_shape_result = body_shape_settings.Create();
+  ShapeRefC body_shape = body_shape_result.Get();
+  BodyCreationSettings body_settings(body_shape, RVec3(0.0, 0.0, 0.0), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
+  body_settings.mMaxLinearVelocity = 10000.0;
+  body_settings.mApplyGyroscopicForce = true;
+  body_settings.mLinearDamping = 0.0;
+  body_settings.mAngularDamping = 0.0;
+  Body *body = body_interface.CreateBody(body_settings);
+  body_interface.AddBody(body->GetID(), EActivation::Activate);
+  body_interface.SetLinearVelocity(body->GetID(), Vec3(0.0, 0.0, 0.0));
+  body_interface.SetAngularVelocity(body->GetID(), Vec3(0.3, 0.0, 5.0));
+  return body;
+}
+
+// Simulate the cuboid with a fixed time step and return the drift of the invariants and the wall time used
+static Drift simulate(const PhysicsSettings &settings, double dt, int collision_steps, double duration,
+                      TempAllocator &temp_allocator, JobSystem &job_system, double &elapsed)
+{
+  BPLayerInterfaceImpl broad_phase_layer_interface;
+  ObjectLayerPairFilterImpl object_vs_object_layer_filter;
+  ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
+
+  PhysicsSystem physics_system;
+  physics_system.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
+                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(settings);
+  physics_system.SetGravity(Vec3::sZero());
+  BodyInterface &body_interface = physics_system.GetBodyInterface();
+  Body *body = createCuboid(body_interface);
+
+  Drift drift = startDrift(computeInvariants(*body));
+  uint64 steps = (uint64)ceil(duration / dt);
+  elapsed = 0.0;
+  for (uint64 step=0; step<steps; step++) {
+    auto start = chrono::steady_clock::now();
+    physics_system.Update(dt, collision_steps, &temp_allocator, &job_system);
+    elapsed += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    updateDrift(drift, computeInvariants(*body));
+  };
+
+  body_interface.RemoveBody(body->GetID());
+  body_interface.DestroyBody(body->GetID());
+  return drift;
+}
+
+// Sweep over time step and number of collision steps and report accuracy against cost
+static void sweep(const Options &options, TempAllocator &temp_allocator, JobSystem &job_system)
+{
+  double duration = options.getDouble("duration", 20.0);
+  double tolerance = options.getDouble("tolerance", 1e-3);
+  PhysicsSettings settings = physicsSettings(options);
+  const double time_steps[] = {1.0 / 15, 1.0 / 30, 1.0 / 60, 1.0 / 120, 1.0 / 240, 1.0 / 480};
+  const int collision_steps[] = {1, 2, 4};
+  double best_cost = 0.0;
+  double best_dt = 0.0;
+  int best_collision_steps = 0;
+  printf("%10s %10s %14s %14s %14s %12s\n", "dt", "collision", "energy drift", "momentum drift", "axis dev/deg", "cost/ms per s");
+  for (double dt: time_steps)
+    for (int steps: collision_steps) {
+      double elapsed;
+      Drift drift = simulate(settings, dt, steps, duration, temp_allocator, job_system, elapsed);
+      double cost = 1000.0 * elapsed / duration;
+      printf("%10.6f %10d %14.3e %14.3e %14.4f %12.4f\n", dt, steps, drift.energy, drift.momentum,
+             RadiansToDegrees((float)drift.angle), cost);
+      if (drift.energy < tolerance && drift.momentum < tolerance && (best_dt == 0.0 || cost < best_cost)) {
+        best_cost = cost;
+        best_dt = dt;
+        best_collision_steps = steps;
+      };
+    };
+  if (best_dt > 0.0)
+    printf("Cheapest setting with drift below %g: dt = %.6f, %d collision step(s), %.4f ms per simulated second\n",
+           tolerance, best_dt, best_collision_steps, best_cost);
+  else
+    printf("No setting keeps the drift below %g\n", tolerance);
+}
+
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  width = options.getInt("width", width);
+  height = options.getInt("height", height);
+  Capture capture(options, width, height);
+
+  registerAllocator(options);
+  Trace = TraceImpl;
+  JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
+  Factory::sInstance = new Factory();
+  RegisterTypes();
+
+  TempAllocatorMalloc temp_allocator;
+  JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
+
+  if (options.has("sweep")) {
+    sweep(options, temp_allocator, job_system);
+    printMemoryReport(cout);
+    UnregisterTypes();
+    delete Factory::sInstance;
+    Factory::sInstance = nullptr;
+    return 0;
+  };
+
   glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  capture.hints();
   GLFWwindow *window = glfwCreateWindow(width, height, "Tumbling motion with Jolt Physics", NULL, NULL);
   glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
   glewInit();
+  capture.init();
+  FramePacer pacer(options);
 
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
@@ -208,6 +410,8 @@ int main(void)
   GLuint program = glCreateProgram();
   glAttachShader(program, vertexShader);
   glAttachShader(program, fragmentShader);
+  glBindAttribLocation(program, 0, "point");
+  glBindAttribLocation(program, 1, "normal");
   glLinkProgram(program);
   handleLinkError("Shader program", program);
 
@@ -243,56 +447,38 @@ int main(void)
   float light[3] = {0.36f, 0.8f, -0.48f};
   glUniform3fv(glGetUniformLocation(program, "light"), 1, light);
   glUniform1f(glGetUniformLocation(program, "aspect"), (float)width / (float)height);
-  float a = 1.0;
-  float b = 0.1;
-  float c = 0.5;
   float axes[3] = {a, b, c};
   glUniform3fv(glGetUniformLocation(program, "axes"), 1, axes);
 
-  RegisterDefaultAllocator();
-  Trace = TraceImpl;
-  JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
-  Factory::sInstance = new Factory();
-  RegisterTypes();
-
-  TempAllocatorMalloc temp_allocator;
-  JobSystemThreadPool job_system(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
-
-  const uint cMaxBodies = 1024;
-  const uint cNumBodyMutexes = 0;
-  const uint cMaxBodyPairs = 1024;
-  const uint cMaxContactConstraints = 1024;
   BPLayerInterfaceImpl broad_phase_layer_interface;
   ObjectLayerPairFilterImpl object_vs_object_layer_filter;
   ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
 
   PhysicsSystem physics_system;
-  physics_system.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
-                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  initPhysicsSystem(physics_system, cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                    broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
   physics_system.SetGravity(Vec3::sZero());
   BodyInterface &body_interface = physics_system.GetBodyInterface();
 
-  BoxShapeSettings body_shape_settings(Vec3(a, b, c));
-  body_shape_settings.mConvexRadius = 0.01;
-  body_shape_settings.SetDensity(1000.0);
-  body_shape_settings.SetEmbedded();
-  ShapeSettings::ShapeResult body_shape_result = body_shape_settings.Create();
-  ShapeRefC body_shape = body_shape_result.Get();
-  BodyCreationSettings body_settings(body_shape, RVec3(0.0, 0.0, 0.0), Quat::sIdentity(), EMotionType::Dynamic, Layers::MOVING);
-  body_settings.mMaxLinearVelocity = 10000.0;
-  body_settings.mApplyGyroscopicForce = true;
-  body_settings.mLinearDamping = 0.0;
-  body_settings.mAngularDamping = 0.0;
-  Body *body = body_interface.CreateBody(body_settings);
-  body_interface.AddBody(body->GetID(), EActivation::Activate);
-  body_interface.SetLinearVelocity(body->GetID(), Vec3(0.0, 0.0, 0.0));
-  body_interface.SetAngularVelocity(body->GetID(), Vec3(0.3, 0.0, 5.0));
+  Body *body = createCuboid(body_interface);
 
   physics_system.OptimizeBroadPhase();
 
+  unique_ptr<Telemetry> telemetry;
+  if (options.has("telemetry"))
+    telemetry.reset(new Telemetry(options.getString("telemetry", ""), stateColumns({"energy", "momentum"})));
+  uint64 step = 0;
+  double sim_time = 0.0;
+  Drift drift = startDrift(computeInvariants(*body));
+  double report = glfwGetTime();
+
+  // Key M prints the memory report
+  bool memory_down = false;
+  pacer.init();
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
-    double dt = glfwGetTime() - t;
+    double dt = capture.enabled() ? capture.timestep() : glfwGetTime() - t;
     RMat44 transform = body_interface.GetWorldTransform(body->GetID());
     RVec3 position = transform.GetTranslation();
     Vec3 x = transform.GetAxisX();
@@ -302,22 +488,50 @@ int main(void)
     glUniform3fv(glGetUniformLocation(program, "translation"), 1, translation);
     float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
     glUniformMatrix3fv(glGetUniformLocation(program, "rotation"), 1, GL_TRUE, rotation);
+    capture.beginFrame();
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-    glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
-    glfwSwapBuffers(window);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
+    capture.endFrame();
+    pacer.swapBuffers(window);
     glfwPollEvents();
+    bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memory && !memory_down)
+      printMemoryReport(cout);
+    memory_down = memory;
+    if (capture.done())
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
     const int cCollisionSteps = 1;
-    physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+    {
+      MemoryScope scope(MemoryCategory::STEP);
+      pacer.beginPhysics();
+      physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+      pacer.endPhysics();
+    }
+    step++;
+    sim_time += dt;
+    updateDrift(drift, computeInvariants(*body));
+    if (telemetry)
+      pushBody(*telemetry, step, sim_time, 0, body_interface, body->GetID(), {drift.current.energy, drift.current.momentum});
+    if (glfwGetTime() >= report + 1.0) {
+      printDrift(cout, drift, step);
+      report += 1.0;
+    };
     t += dt;
+    pacer.endFrame();
   }
 
+  printDrift(cout, drift, step);
+
   body_interface.RemoveBody(body->GetID());
   body_interface.DestroyBody(body->GetID());
 
+  printMemoryReport(cout);
   UnregisterTypes();
   delete Factory::sInstance;
   Factory::sInstance = nullptr;
 
+  capture.finish();
+
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glDeleteBuffers(1, &idx);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -1,6 +1,11 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <cmath>
 #include <cstdarg>
 #include <thread>
+#include <vector>
 #include <Jolt/Jolt.h>
 #include <Jolt/Core/Factory.h>
 #include <Jolt/RegisterTypes.h>
@@ -16,6 +21,14 @@
 #include <Jolt/Physics/Body/BodyCreationSettings.h>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "options.hh"
+#include "capture.hh"
+#include "telemetry.hh"
+#include "physics_settings.hh"
+#include "allocator.hh"
+#include "frame_pacer.hh"
+#include "overlay.hh"
+#include "stream_buffer.hh"
 
 
 using namespace std;
@@ -119,18 +132,19 @@ const char *vertex_wheel = "#version 410 core\n\
 uniform float aspect;\n\
 uniform float radius;\n\
 uniform int num_points;\n\
-uniform vec3 translation;\n\
-uniform mat3 rotation;\n\
-in vec3 point;\n\
+in vec3 axis_x;\n\
+in vec3 axis_y;\n\
+in vec3 axis_z;\n\
+in vec3 translation;\n\
 out vec3 color;\n\
 void main()\n\
 {\n\
-  vec3 radius_vector = radius * vec3(0, sin(2.0 * 3.1415926 * gl_InstanceID / num_points), cos(2.0 * 3.1415926 * gl_InstanceID / num_points));\n\
-  if (gl_InstanceID == 0)\n\
+  vec3 radius_vector = radius * vec3(0, sin(2.0 * 3.1415926 * gl_VertexID / num_points), cos(2.0 * 3.1415926 * gl_VertexID / num_points));\n\
+  if (gl_VertexID == 0)\n\
     color = vec3(1, 0, 0);\n\
   else\n\
     color = vec3(1, 1, 1);\n\
-  gl_Position = vec4(((rotation * (point + radius_vector) + translation) * vec3(1, aspect, 1)).zyx, 1);\n\
+  gl_Position = vec4(((mat3(axis_x, axis_y, axis_z) * radius_vector + translation) * vec3(1, aspect, 1)).zyx, 1);\n\
 }";
 
 const char *fragment_wheel = "#version 410 core\n\
@@ -182,20 +196,21 @@ GLfloat vertices_body[] = {
 };
 
 unsigned int indices_body[] = {
-   0,  1,  2,  3,
-   4,  5,  6,  7,
-   8,  9, 10, 11,
-  12, 13, 14, 15,
-  16, 17, 18, 19,
-  20, 21, 22, 23
-};
-
-GLfloat vertices_wheel[] = {
-   0.0f,  0.0f,  0.0f
+   0,  1,  2,  0,  2,  3,
+   4,  5,  6,  4,  6,  7,
+   8,  9, 10,  8, 10, 11,
+  12, 13, 14, 12, 14, 15,
+  16, 17, 18, 16, 18, 19,
+  20, 21, 22, 20, 22, 23
 };
 
-unsigned int indices_wheel[] = {
-   0
+// Per wheel data of the instanced wheel draw, the points of the rim are generated from the vertex index
+struct WheelInstance
+{
+  float axis_x[3];
+  float axis_y[3];
+  float axis_z[3];
+  float translation[3];
 };
 
 void handleCompileError(const char *step, GLuint shader)
@@ -222,12 +237,106 @@ void handleLinkError(const char *step, GLuint program)
   };
 }
 
-int main(void)
+// Keyboard state of the driver controls, updated by the key callback
+struct Keys
 {
+  bool forward;
+  bool backward;
+  bool left;
+  bool right;
+  bool hand_brake;
+};
+
+static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+  if (action == GLFW_REPEAT)
+    return;
+  Keys *keys = (Keys *)glfwGetWindowUserPointer(window);
+  bool pressed = action == GLFW_PRESS;
+  switch (key) {
+    case GLFW_KEY_W:
+    case GLFW_KEY_UP:
+      keys->forward = pressed;
+      break;
+    case GLFW_KEY_S:
+    case GLFW_KEY_DOWN:
+      keys->backward = pressed;
+      break;
+    case GLFW_KEY_A:
+    case GLFW_KEY_LEFT:
+      keys->left = pressed;
+      break;
+    case GLFW_KEY_D:
+    case GLFW_KEY_RIGHT:
+      keys->right = pressed;
+      break;
+    case GLFW_KEY_SPACE:
+      keys->hand_brake = pressed;
+      break;
+  };
+}
+
+static void joystickCallback(int joystick, int event)
+{
+  if (event == GLFW_CONNECTED && glfwJoystickIsGamepad(joystick))
+    cerr << "Gamepad connected: " << glfwGetGamepadName(joystick) << endl;
+  else if (event == GLFW_DISCONNECTED)
+    cerr << "Joystick " << joystick << " disconnected" << endl;
+}
+
+// Combine keyboard and first gamepad into the driver input of the vehicle controller. Throttle against the direction
+// of travel brakes the car instead of engaging the reverse gear until it has (almost) stopped.
+static void driverInput(const Keys &keys, float forward_speed, float &forward, float &right, float &brake,
+                        float &hand_brake)
+{
+  float throttle = (keys.forward ? 1.0f : 0.0f) - (keys.backward ? 1.0f : 0.0f);
+  right = (keys.right ? 1.0f : 0.0f) - (keys.left ? 1.0f : 0.0f);
+  hand_brake = keys.hand_brake ? 1.0f : 0.0f;
+  GLFWgamepadstate state;
+  if (glfwJoystickIsGamepad(GLFW_JOYSTICK_1) && glfwGetGamepadState(GLFW_JOYSTICK_1, &state)) {
+    // Triggers go from -1 (released) to 1, the stick has a small dead zone
+    throttle += 0.5f * (state.axes[GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER] + 1.0f);
+    throttle -= 0.5f * (state.axes[GLFW_GAMEPAD_AXIS_LEFT_TRIGGER] + 1.0f);
+    float steer = state.axes[GLFW_GAMEPAD_AXIS_LEFT_X];
+    if (fabs(steer) > 0.1f)
+      right += steer;
+    if (state.buttons[GLFW_GAMEPAD_BUTTON_A] == GLFW_PRESS)
+      hand_brake = 1.0f;
+  };
+  throttle = clamp(throttle, -1.0f, 1.0f);
+  right = clamp(right, -1.0f, 1.0f);
+  forward = throttle;
+  brake = 0.0f;
+  if (throttle * forward_speed < 0.0f && fabs(forward_speed) > 0.05f) {
+    forward = 0.0f;
+    brake = fabs(throttle);
+  };
+}
+
+int main(int argc, char *argv[])
+{
+  Options options(argc, argv);
+  width = options.getInt("width", width);
+  height = options.getInt("height", height);
+  Capture capture(options, width, height);
+
   glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  capture.hints();
   GLFWwindow *window = glfwCreateWindow(width, height, "Wheeled vehicle with Jolt Physics", NULL, NULL);
   glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
   glewInit();
+  capture.init();
+  FramePacer pacer(options);
+
+  Keys keys = {false, false, false, false, false};
+  glfwSetWindowUserPointer(window, &keys);
+  glfwSetKeyCallback(window, keyCallback);
+  glfwSetJoystickCallback(joystickCallback);
 
   const float wheel_radius = 0.03f;
   const float wheel_width = 0.02f;
@@ -235,7 +344,7 @@ int main(void)
   const float half_vehicle_length = 0.15f;
   const float half_vehicle_width = 0.1f;
   const float half_vehicle_height = 0.02f;
-  // const float max_steering_angle = DegreesToRadians(30.0f);
+  const float max_steering_angle = DegreesToRadians(30.0f);
 
   glClearColor(0.1f, 0.1f, 0.1f, 0.0f);
   glViewport(0, 0, width, height);
@@ -253,6 +362,8 @@ int main(void)
   GLuint program_body = glCreateProgram();
   glAttachShader(program_body, vertex_shader_body);
   glAttachShader(program_body, fragment_shader_body);
+  glBindAttribLocation(program_body, 0, "point");
+  glBindAttribLocation(program_body, 1, "normal");
   glLinkProgram(program_body);
   handleLinkError("Shader program", program_body);
 
@@ -299,6 +410,10 @@ int main(void)
   GLuint program_wheel = glCreateProgram();
   glAttachShader(program_wheel, vertex_shader_wheel);
   glAttachShader(program_wheel, fragment_shader_wheel);
+  glBindAttribLocation(program_wheel, 0, "axis_x");
+  glBindAttribLocation(program_wheel, 1, "axis_y");
+  glBindAttribLocation(program_wheel, 2, "axis_z");
+  glBindAttribLocation(program_wheel, 3, "translation");
   glLinkProgram(program_wheel);
   handleLinkError("Shader program", program_wheel);
 
@@ -311,33 +426,27 @@ int main(void)
   float axes[3] = {a, b, c};
   glUniform3fv(glGetUniformLocation(program_body, "axes"), 1, axes);
 
+  const int num_wheels = 3;
   GLuint vao_wheel;
-  GLuint vbo_wheel;
-  GLuint idx_wheel;
 
   glGenVertexArrays(1, &vao_wheel);
   glBindVertexArray(vao_wheel);
 
-  glGenBuffers(1, &vbo_wheel);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_wheel);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_wheel), vertices_wheel, GL_STATIC_DRAW);
-  glGenBuffers(1, &idx_wheel);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_wheel);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices_wheel), indices_wheel, GL_STATIC_DRAW);
+  StreamBuffer wheel_buffer(GL_ARRAY_BUFFER, num_wheels * sizeof(WheelInstance), !options.has("no-persistent"));
+  wheel_buffer.init();
 
   glUseProgram(program_wheel);
 
-  glVertexAttribPointer(glGetAttribLocation(program_wheel, "point"),
-                        3, GL_FLOAT, GL_FALSE,
-                        3 * sizeof(float), (void *)0);
-
-  glEnableVertexAttribArray(0);
+  for (int i=0; i<4; i++) {
+    glVertexAttribDivisor(i, 1);
+    glEnableVertexAttribArray(i);
+  };
 
   glUniform1f(glGetUniformLocation(program_wheel, "aspect"), (float)width / (float)height);
   glUniform1f(glGetUniformLocation(program_wheel, "radius"), wheel_radius);
   glUniform1i(glGetUniformLocation(program_wheel, "num_points"), num_points);
 
-  RegisterDefaultAllocator();
+  registerAllocator(options);
   Trace = TraceImpl;
   JPH_IF_ENABLE_ASSERTS(AssertFailed = AssertFailedImpl;)
   Factory::sInstance = new Factory();
@@ -355,8 +464,9 @@ int main(void)
   ObjectVsBroadPhaseLayerFilterImpl object_vs_broadphase_layer_filter;
 
   PhysicsSystem physics_system;
-  physics_system.Init(cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints, broad_phase_layer_interface,
-                      object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  initPhysicsSystem(physics_system, cMaxBodies, cNumBodyMutexes, cMaxBodyPairs, cMaxContactConstraints,
+                    broad_phase_layer_interface, object_vs_broadphase_layer_filter, object_vs_object_layer_filter);
+  physics_system.SetPhysicsSettings(physicsSettings(options));
   physics_system.SetGravity(Vec3(0, -0.4, 0));
   BodyInterface &body_interface = physics_system.GetBodyInterface();
 
@@ -386,7 +496,7 @@ int main(void)
   w1->mSuspensionMinLength = wheel_radius;
   w1->mSuspensionMaxLength = 2 * wheel_radius;
   w1->mAngularDamping = 0.0f;
-  w1->mMaxSteerAngle = 0.0f; // max_steering_angle;
+  w1->mMaxSteerAngle = max_steering_angle;
   w1->mMaxHandBrakeTorque = 0.0f;
   w1->mInertia = 0.1;
   w1->mRadius = wheel_radius;
@@ -416,6 +526,11 @@ int main(void)
 
   WheeledVehicleControllerSettings *controller = new WheeledVehicleControllerSettings;
   vehicle.mController = controller;
+  // Rear wheel drive, the default engine torque is far too much for a car of this size
+  controller->mDifferentials.resize(1);
+  controller->mDifferentials[0].mLeftWheel = 1;
+  controller->mDifferentials[0].mRightWheel = 2;
+  controller->mEngine.mMaxTorque = options.getDouble("max-torque", 2.0);
 
   Body *car_body = body_interface.CreateBody(car_body_settings);
   body_interface.AddBody(car_body->GetID(), EActivation::Activate);
@@ -431,55 +546,159 @@ int main(void)
   body_interface.SetLinearVelocity(car_body->GetID(), Vec3(0.0f, 0.0f, 3.0f));
   body_interface.SetAngularVelocity(car_body->GetID(), Vec3(0.015, 0.0, 0.25));
 
+  unique_ptr<Telemetry> telemetry;
+  if (options.has("telemetry"))
+    telemetry.reset(new Telemetry(options.getString("telemetry", ""), stateColumns({"wheel_angle", "wheel_speed", "suspension_length", "contact", "longitudinal_slip", "lateral_slip"})));
+  uint64 step = 0;
+  double sim_time = 0.0;
+
+  // The overlay shows averages over the last refresh interval to keep it readable
+  const double cOverlayInterval = 0.25;
+  bool show_overlay = !options.has("no-overlay");
+  Overlay overlay(width, height);
+  overlay.init();
+  double overlay_time = 0.0;
+  double frame_total = 0.0;
+  double step_total = 0.0;
+  double step_max = 0.0;
+  int frames = 0;
+  vector<double> step_times;
+
+  // Key M prints the memory report
+  bool memory_down = false;
+  pacer.init();
   double t = glfwGetTime();
   while (!glfwWindowShouldClose(window)) {
-    double dt = glfwGetTime() - t;
+    double dt = capture.enabled() ? capture.timestep() : glfwGetTime() - t;
+    capture.beginFrame();
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
     body_interface.ActivateBody(constraint->GetVehicleBody()->GetID());
+    Vec3 velocity = car_body->GetLinearVelocity();
+    float forward_speed = velocity.Dot(car_body->GetRotation() * Vec3::sAxisZ());
+    float forward, right, brake, hand_brake;
+    driverInput(keys, forward_speed, forward, right, brake, hand_brake);
+    vehicle_controller->SetDriverInput(forward, right, brake, hand_brake);
 
     glUseProgram(program_body);
     glBindVertexArray(vao_body);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_body);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_body);
     RMat44 transform = body_interface.GetWorldTransform(car_body->GetID());
     RVec3 position = transform.GetTranslation();
+    // Wrap the car around the edges of the screen and keep it inside the depth range (x) when steering
     double pz = position.GetZ();
     while (pz >= 1.0)
       pz -= 2.0;
+    while (pz < -1.0)
+      pz += 2.0;
     double dz = pz - position.GetZ();
+    double px = position.GetX();
+    while (px >= 1.0)
+      px -= 2.0;
+    while (px < -1.0)
+      px += 2.0;
+    double dx = px - position.GetX();
     Vec3 x = transform.GetAxisX();
     Vec3 y = transform.GetAxisY();
     Vec3 z = transform.GetAxisZ();
-    float translation[3] = {(float)position.GetX(), (float)position.GetY(), (float)(position.GetZ() + dz)};
+    float translation[3] = {(float)(position.GetX() + dx), (float)position.GetY(), (float)(position.GetZ() + dz)};
     glUniform3fv(glGetUniformLocation(program_body, "translation"), 1, translation);
     float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
     glUniformMatrix3fv(glGetUniformLocation(program_body, "rotation"), 1, GL_TRUE, rotation);
-    glDrawElements(GL_QUADS, 24, GL_UNSIGNED_INT, (void *)0);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void *)0);
 
-    glUseProgram(program_wheel);
-    glBindVertexArray(vao_wheel);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_wheel);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, idx_wheel);
-    for (int i=0; i<3; i++) {
+    WheelInstance *wheels = (WheelInstance *)wheel_buffer.map();
+    for (int i=0; i<num_wheels; i++) {
       RMat44 transform = constraint->GetWheelWorldTransform(i, Vec3::sAxisX(), Vec3::sAxisZ());
       RVec3 position = transform.GetTranslation();
-      Vec3 x = transform.GetAxisX();
-      Vec3 y = transform.GetAxisY();
-      Vec3 z = transform.GetAxisZ();
-      float translation[3] = {(float)position.GetX(), (float)position.GetY(), (float)(position.GetZ() + dz)};
-      glUniform3fv(glGetUniformLocation(program_wheel, "translation"), 1, translation);
-      float rotation[9] = {x.GetX(), y.GetX(), z.GetX(), x.GetY(), y.GetY(), z.GetY(), x.GetZ(), y.GetZ(), z.GetZ()};
-      glUniformMatrix3fv(glGetUniformLocation(program_wheel, "rotation"), 1, GL_TRUE, rotation);
-      glDrawElementsInstanced(GL_POINTS, 1, GL_UNSIGNED_INT, (void *)0, num_points);
+      transform.GetAxisX().StoreFloat3((Float3 *)wheels[i].axis_x);
+      transform.GetAxisY().StoreFloat3((Float3 *)wheels[i].axis_y);
+      transform.GetAxisZ().StoreFloat3((Float3 *)wheels[i].axis_z);
+      wheels[i].translation[0] = (float)(position.GetX() + dx);
+      wheels[i].translation[1] = (float)position.GetY();
+      wheels[i].translation[2] = (float)(position.GetZ() + dz);
+    };
+    size_t offset = wheel_buffer.unmap(num_wheels * sizeof(WheelInstance));
+    glUseProgram(program_wheel);
+    glBindVertexArray(vao_wheel);
+    glBindBuffer(GL_ARRAY_BUFFER, wheel_buffer.buffer());
+    for (int i=0; i<4; i++)
+      glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, sizeof(WheelInstance), (void *)(offset + 3 * i * sizeof(float)));
+    glDrawArraysInstanced(GL_POINTS, 0, num_points, num_wheels);
+    wheel_buffer.fence();
+
+    if (show_overlay) {
+      frame_total += dt;
+      frames++;
+      overlay_time += dt;
+      if (overlay_time >= cOverlayInterval || frames == 1) {
+        overlay.clear();
+        overlay.print("FRAME %.2f MS  STEP %.3f MS (MAX %.3f MS)", 1000.0 * frame_total / frames,
+                      step_total / frames, step_max);
+        overlay.print("SPEED %.2f M/S  RPM %.0f  GEAR %d", forward_speed,
+                      vehicle_controller->GetEngine().GetCurrentRPM(),
+                      vehicle_controller->GetTransmission().GetCurrentGear());
+        overlay.print("THROTTLE %.2f  STEER %.2f  BRAKE %.2f  HANDBRAKE %.2f", forward, right, brake, hand_brake);
+        for (uint i=0; i<constraint->GetWheels().size(); i++) {
+          const WheelWV *wheel = static_cast<const WheelWV *>(constraint->GetWheel(i));
+          overlay.print("WHEEL %u %s  LONG SLIP %6.3f  LAT SLIP %6.3f", i, wheel->HasContact() ? "CONTACT" : "IN AIR ",
+                        wheel->mLongitudinalSlip, wheel->mLateralSlip);
+        };
+        overlay_time = 0.0;
+        frame_total = 0.0;
+        step_total = 0.0;
+        step_max = 0.0;
+        frames = 0;
+      };
+      overlay.draw();
     };
 
-    glfwSwapBuffers(window);
+    capture.endFrame();
+    pacer.swapBuffers(window);
     glfwPollEvents();
+    bool memory = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memory && !memory_down)
+      printMemoryReport(cout);
+    memory_down = memory;
+    if (capture.done())
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
     const int cCollisionSteps = 1;
-    physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+    auto start = chrono::steady_clock::now();
+    {
+      MemoryScope scope(MemoryCategory::STEP);
+      pacer.beginPhysics();
+      physics_system.Update(dt, cCollisionSteps, &temp_allocator, &job_system);
+      pacer.endPhysics();
+    }
+    double step_time = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    step_times.push_back(step_time);
+    step_total += step_time;
+    step_max = max(step_max, step_time);
+    step++;
+    sim_time += dt;
+    if (telemetry) {
+      pushBody(*telemetry, step, sim_time, 0, body_interface, car_body->GetID());
+      for (uint i=0; i<constraint->GetWheels().size(); i++) {
+        const WheelWV *wheel = static_cast<const WheelWV *>(constraint->GetWheel(i));
+        RMat44 transform = constraint->GetWheelWorldTransform(i, Vec3::sAxisX(), Vec3::sAxisZ());
+        pushState(*telemetry, step, sim_time, i + 1, transform.GetTranslation(), transform.GetRotation().GetQuaternion(),
+                  Vec3::sNaN(), Vec3::sNaN(),
+                  {wheel->GetRotationAngle(), wheel->GetAngularVelocity(), wheel->GetSuspensionLength(),
+                   wheel->HasContact() ? 1.0 : 0.0, wheel->mLongitudinalSlip, wheel->mLateralSlip});
+      };
+    };
     t += dt;
+    pacer.endFrame();
   }
 
+  if (!step_times.empty()) {
+    double total = 0.0;
+    for (double time: step_times)
+      total += time;
+    sort(step_times.begin(), step_times.end());
+    printf("%zu steps: mean %.4f ms, p50 %.4f ms, p95 %.4f ms, max %.4f ms\n", step_times.size(),
+           total / step_times.size(), step_times[step_times.size() / 2], step_times[step_times.size() * 95 / 100],
+           step_times.back());
+  };
+
   physics_system.RemoveStepListener(constraint);
   physics_system.RemoveConstraint(constraint);
 
@@ -487,10 +706,14 @@ int main(void)
   body_interface.RemoveBody(car_body->GetID());
   body_interface.RemoveBody(ground->GetID());
 
+  printMemoryReport(cout);
   UnregisterTypes();
   delete Factory::sInstance;
   Factory::sInstance = nullptr;
 
+  capture.finish();
+  overlay.finish();
+
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
@@ -499,8 +722,7 @@ int main(void)
   glDeleteBuffers(1, &vbo_body);
   glDeleteVertexArrays(1, &vao_body);
 
-  glDeleteBuffers(1, &idx_wheel);
-  glDeleteBuffers(1, &vbo_wheel);
+  wheel_buffer.finish();
   glDeleteVertexArrays(1, &vao_wheel);
 
   glDeleteProgram(program_body);